@@ -7,6 +7,9 @@
 #include <cmath>
 #include <algorithm>
 #include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <actionlib/server/simple_action_server.h>
 #include <mtg_controller/PurePursuitAction.h>
 #include <mtg_controller/mtgControllerAction.h>
@@ -22,10 +25,11 @@
 #include <nav_msgs/Odometry.h>
 #include <ackermann_msgs/AckermannDriveStamped.h>
 
-#include <kdl/frames.hpp>
 #include <mtg_controller/PurePursuitConfig.h>
 #include <angles/angles.h>
 
+#include "pure_pursuit_tracker.hpp"
+
 class ControllerAction
 {
 private:
@@ -52,9 +56,15 @@ private:
   // Control variables for Ackermann steering
   // Steering angle is denoted by delta
   double delta_, delta_vel_, acc_, jerk_, delta_max_;
-  std::queue<std::vector<double>> path_;
-  unsigned idx_;
+  // Waypoints with their times, time_idx_ is the next one to reach
+  AgentPath path_;
+  size_t time_idx_;
+  // goal_reached_ is written by the timer, preempt_requested_ by preemptCB and both are read
+  // by executeCB, all under goal_mutex_. The action server is never called with it held.
   bool goal_reached_;
+  bool preempt_requested_;
+  std::mutex goal_mutex_;
+  std::condition_variable goal_cv_;
   geometry_msgs::Twist cmd_vel_;
 protected:
 
@@ -68,12 +78,13 @@ public:
 
   ControllerAction(std::string name) :
     as_(nh_, name, boost::bind(&ControllerAction::executeCB, this, _1), false),action_name_(name),
-    ld_(1.0), v_max_(0.5), v_(v_max_), w_max_(0.3), pos_tol_(0.1), idx_(0),goal_reached_(true), 
+    ld_(1.0), v_max_(0.5), v_(v_max_), w_max_(0.3), pos_tol_(0.1), time_idx_(0),goal_reached_(true), preempt_requested_(false), 
     nh_private_("~"), tf_listener_(tf_buffer_), map_frame_id_("map"), robot_frame_id_("base_link"),
     lookahead_frame_id_("lookahead"), controller_period_s(0.1), controller_it(0), v_linear_last(0.0),
     time_last(0.0), rotate_to_global_plan(true)
   {
     
+    as_.registerPreemptCallback(boost::bind(&ControllerAction::preemptCB, this));
     as_.start();
   }
 
@@ -90,20 +101,29 @@ public:
     controller_timer = nh_.createTimer(ros::Duration(controller_period_s),boost::bind(&ControllerAction::computeVelocities, this, _1));
     pub_vel_ = nh_.advertise<geometry_msgs::Twist>(goal->agent_name+"/cmd_vel", 1);
 
-    while(!goal_reached_)
+    // A cancel that came in before the goal was accepted does not call preemptCB
+    if (as_.isPreemptRequested())
+      preemptCB();
+
+    // Sleep until the timer reports the goal reached or a preempt request wakes us up,
+    // the timeout only makes sure a ROS shutdown is noticed
+    bool preempted = false;
     {
-      if (as_.isPreemptRequested() || !ros::ok())
-      {
-        ROS_INFO("%s: Preempted", action_name_.c_str());
-        // set the action state to preempted
-        as_.setPreempted();
-        success = false;
-        controller_timer.stop();
-        break;
-      }
+      std::unique_lock<std::mutex> lock(goal_mutex_);
+      while(!goal_reached_ && !preempt_requested_ && ros::ok())
+        goal_cv_.wait_for(lock, std::chrono::seconds(1));
+      preempted = !goal_reached_;
     }
 
-    if(goal_reached_)
+    if(preempted)
+    {
+      ROS_INFO("%s: Preempted", action_name_.c_str());
+      // set the action state to preempted
+      as_.setPreempted();
+      success = false;
+      controller_timer.stop();
+    }
+    else
     {
       controller_timer.stop();
       result_.goal_reached = true;
@@ -112,29 +132,54 @@ public:
       as_.setSucceeded(result_);
       controller_timer.stop();
     }
+
+    // The goal is done, a preempt request for it must not end the next one
+    std::lock_guard<std::mutex> lock(goal_mutex_);
+    preempt_requested_ = false;
   }
 
   ~ControllerAction(void)
   {
   }
+  // Wakes executeCB up when the goal is reached
+  void setGoalReached(bool reached)
+  {
+    {
+      std::lock_guard<std::mutex> lock(goal_mutex_);
+      goal_reached_ = reached;
+    }
+    goal_cv_.notify_all();
+  }
+
+  // Called by the action server when the goal is cancelled or replaced
+  // actionlib calls it holding its own lock, so it only takes goal_mutex_ and never calls back into as_
+  void preemptCB()
+  {
+    {
+      std::lock_guard<std::mutex> lock(goal_mutex_);
+      preempt_requested_ = true;
+    }
+    goal_cv_.notify_all();
+  }
+
   void receivePath(nav_msgs::Path new_path)
   {
     ROS_INFO("Receiving path!");
 
     if(new_path.poses.size()>0)
     {
+      path_.clear();
+      path_.reserve(new_path.poses.size());
+      time_idx_ = 0;
       for (int idx_ = 0; idx_ < new_path.poses.size(); idx_++){
-        std::vector<double> coordinates;
-        coordinates.push_back(new_path.poses[idx_].pose.position.x);
-        coordinates.push_back(new_path.poses[idx_].pose.position.y);
-        coordinates.push_back(new_path.poses[idx_].pose.position.z);
-        path_.push(coordinates);
+        path_.push_back(RVO::Vector2(new_path.poses[idx_].pose.position.x, new_path.poses[idx_].pose.position.y),
+                        new_path.poses[idx_].pose.position.z); // time
       }
-       goal_reached_ = false;
+       setGoalReached(false);
     }
     else
     {
-      goal_reached_ = true;
+      setGoalReached(true);
       ROS_WARN_STREAM("Received empty path!");
     }
     // When a new path received, the previous one is simply discarded
@@ -153,11 +198,11 @@ public:
 
     geometry_msgs::TransformStamped tf;
     tf = tf_buffer_.lookupTransform(map_frame_id_, robot_frame_id_, ros::Time(0));
-    double yaw = tf::getYaw(tf.transform.rotation);
-    ROS_INFO("Transform x: %f y:%f yaw:%f",tf.transform.translation.x,tf.transform.translation.y,yaw);
+    SE2 pose = se2FromTransformMsg(tf.transform);
+    ROS_INFO("Transform x: %f y:%f yaw:%f",pose.x,pose.y,pose.yaw());
 
     if(rotate_to_global_plan) {
-        double angle_to_global_plan = calculateGlobalPlanAngle(tf.transform.translation.x,tf.transform.translation.y,yaw);
+        double angle_to_global_plan = calculateGlobalPlanAngle(pose);
         ROS_INFO("Shortest angle to goal %f",angle_to_global_plan);
         rotate_to_global_plan = rotateToOrientation(angle_to_global_plan,0.1);
     }
@@ -168,29 +213,25 @@ public:
       double time_elapsed = controller_it*controller_period_s;
 
       // Synchronise controller time with path_time
-      double path_time = path_.front()[2];
-      int it=0;
-      while(!path_.empty() && time_elapsed>path_time) {
-        it++;
-        // Update time last
-        time_last = path_.front()[2];
-        path_.pop();
-      }
-      ROS_INFO("Popped %d velocities",it);
+      size_t last_idx = time_idx_;
+      time_idx_ = PurePursuitTracker::advanceByTime(path_, time_idx_, time_elapsed, false);
+      // Update time last
+      if(time_idx_ > last_idx)
+        time_last = path_.time(time_idx_ - 1);
+      ROS_INFO("Popped %ld velocities",time_idx_ - last_idx);
 
-      if(!path_.empty()){
+      if(time_idx_ < path_.totalSize()){
 
-        std::vector<double> coordinates = path_.front();
-        std::vector<double> currState{tf.transform.translation.x,tf.transform.translation.y,yaw,v_linear_last}; //TODO getting current v value
+        double v_current = v_linear_last; //TODO getting current v value
 
-        double time_next = coordinates[2];
-        double dx = coordinates[0] - currState[0];
-        double dy = coordinates[1] - currState[1];
+        double time_next = path_.time(time_idx_);
+        double dx = path_[time_idx_].x() - pose.x;
+        double dy = path_[time_idx_].y() - pose.y;
         double v_f = sqrt(dx*dx + dy*dy)/(time_next-time_last);
         double theta_f = atan(dy/dx);
 
-        double vd_x = v_f*cos(theta_f) - currState[3]*cos(currState[2]);
-        double vd_y = v_f*sin(theta_f) - currState[3]*sin(currState[2]);
+        double vd_x = v_f*cos(theta_f) - v_current*pose.c;
+        double vd_y = v_f*sin(theta_f) - v_current*pose.s;
         double vd = sqrt(vd_x*vd_x + vd_y*vd_y);
         double alpha = atan(vd_y/vd_x);
 
@@ -203,7 +244,7 @@ public:
         cmd_vel_.linear.x = 0.0;
         cmd_vel_.angular.z = 0.0;
         pub_vel_.publish(cmd_vel_);
-        goal_reached_ = true;
+        setGoalReached(true);
         ROS_INFO("Stopping!!");
       }
 
@@ -212,14 +253,15 @@ public:
    
   }
 
-  double calculateGlobalPlanAngle(double x, double y, double yaw) {
+  double calculateGlobalPlanAngle(const SE2& pose) {
 
       //Calculate the angles between robotpose and global plan point pose
-      double angle_to_goal = atan2(path_.front()[1] - y,
-                                        path_.front()[0] - x);
+      if(time_idx_ >= path_.totalSize())
+        return 0.0;
+      // Bearing of the waypoint in the robot frame is the shortest angle to it
+      RVO::Vector2 waypoint = pose.inverseTransform(path_[time_idx_]);
 
-      
-      return angles::shortest_angular_distance(yaw, angle_to_goal);
+      return atan2(waypoint.y(), waypoint.x());
   }
 
   bool rotateToOrientation(double angle, double accuracy) {
@@ -287,8 +329,9 @@ public:
         theta = copysign(w_max_,theta);
     }
 
-    ROS_INFO("[mtg Controller]: CMD_LIN %f CMD_ANG %f Tracking %f %f at %f",cmd_robot.vector.x,theta,
-                                                                      path_.front()[0],path_.front()[1],path_.front()[2]);
+    if(time_idx_ < path_.totalSize())
+      ROS_INFO("[mtg Controller]: CMD_LIN %f CMD_ANG %f Tracking %f %f at %f",cmd_robot.vector.x,theta,
+                                                                      path_[time_idx_].x(),path_[time_idx_].y(),path_.time(time_idx_));
 
     cmd_vel_.linear = cmd_robot.vector;
     cmd_vel_.angular.z = theta;
@@ -297,15 +340,6 @@ public:
     cmd_vel_.angular.x = 0.0; cmd_vel_.angular.y = 0.0;
     pub_vel_.publish(cmd_vel_);
   }
-
-
-
-  //! Helper founction for computing eucledian distances in the x-y plane.
-  template<typename T1, typename T2>
-  double distance(T1 pt1, T2 pt2)
-  {
-    return sqrt(pow(pt1.x - pt2.x,2) + pow(pt1.y - pt2.y,2) + pow(pt1.z - pt2.z,2));
-  }
 };
 
 
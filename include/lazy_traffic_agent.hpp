@@ -12,15 +12,20 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/TransformStamped.h>
 #include <ros/ros.h>
-#include <tf2/LinearMath/Quaternion.h>
-#include <tf2/LinearMath/Matrix3x3.h>
 #include "mtg_messages/controller_status.h"
 #include <nav_msgs/OccupancyGrid.h>
 #include <visualization_msgs/Marker.h>
+#include <std_msgs/Float64.h>
 
 
 #include "Vector2.h"
 #include "lazy_traffic_rvo.hpp"
+#include "lazy_traffic_fleet_obstacles.hpp"
+#include "lazy_traffic_path.hpp"
+#include "pure_pursuit_tracker.hpp"
+#include "se2.hpp"
+#include "lazy_traffic_shaper.hpp"
+#include "lazy_traffic_scheduler.hpp"
 #include "mtg_messages/task_graph_getter.h"
 
 typedef std::pair<std::string, float> AgentDistPair;
@@ -32,25 +37,51 @@ using namespace std;
 #define REPULSION_RADIUS (0.5f) //Repulsion radius
 #define COLLISION_THRESH (50) // Collision threshold
 #define USE_STATIC_OBSTACLE_AVOIDANCE (1)
+#define USE_INFLATION_LAYER (0) // Check static obstacles against the inflation layer instead of as point neighbors
 #define MAX_STATIC_OBS_DIST (0.5)
+#define USE_PATH_PREDICTION (1) // Model neighbors by where their paths take them instead of their measured velocity
+#define PREDICTION_HORIZON (1.0) // Time (s) neighbors are predicted ahead along their paths
+
+#define SCHEDULE_LAG_GAIN (0.5) // Speed correction (m/s) per m behind the schedule
+#define SCHEDULE_MIN_SPEED (0.0) // Lets an agent ahead of its schedule wait for it
+
+#define CMD_MAX_LINEAR_ACC (0.5) // m/s^2
+#define CMD_MAX_LINEAR_JERK (2.5) // m/s^3
+#define CMD_MAX_ANGULAR_ACC (2.0) // rad/s^2
+#define CMD_MAX_ANGULAR_JERK (10.0) // rad/s^3
 
 #define SEARCH_ANGULAR_VELOCITY (0.5)
-#define SEARCH_PAUSE_TIMESTEPS (10) // Should ve enough for fps of camera to capture atleast one frame
-#define SEARCH_ROTATION_TIMESTEPS (16)
+#define SEARCH_PAUSE_TIME (2.0) // Should ve enough for fps of camera to capture atleast one frame (s)
+#define SEARCH_SEGMENT_ANGLE (1.6) // Turned between two pauses (rad)
+#define SEARCH_SEGMENT_TIMEOUT (2.0*SEARCH_SEGMENT_ANGLE/SEARCH_ANGULAR_VELOCITY) // Ends a segment the robot does not complete (s)
 #define SEARCH_NUM_ROTATIONS (8)
+
+// Velocity command of one agent, computed in a control tick and published by whoever owns publishing
+struct AgentCommand {
+    ros::Publisher publisher;
+    geometry_msgs::Twist twist;
+    bool stop = false; // Zero command of a stopAgent, it must not be dropped
+};
+
 class Agent {
 
 public:
     Agent() : name_(""), robot_frame_id_(""), current_path_(), current_pose_() {}
     Agent(std::string name, ros::NodeHandle nh) : name_(name), robot_frame_id_(name + "/base_link"), nh_(nh),
-                                                  ld_(0.4), v_max_(0.3), goal_threshold_(0.2), w_max_(0.5), at_rest(true),
+                                                  ld_(0.4), ld_min_(0.25), ld_max_(0.8), ld_speed_gain_(1.5), ld_turn_gain_(1.0),
+                                                  v_max_(0.3), speed_limit_(0.3), goal_threshold_(0.2), w_max_(0.5), at_rest(true),
                                                   preferred_velocity_(RVO::Vector2(0.0, 0.0)), current_velocity_(RVO::Vector2(0.0, 0.0)) {
         // Initialise publisher
         pub_vel_ = nh_.advertise<geometry_msgs::Twist>("/mtg_agent_bringup_node/" + name + "/cmd_vel", 1);
         pub_status_ = nh_.advertise<mtg_messages::controller_status>("/lazy_traffic_controller/" + name + "/status", 1);
         vel_marker_pub_ = nh_.advertise<visualization_msgs::Marker>("/lazy_traffic_controller/" + name + "/vel_marker", 1);
+        pub_schedule_lag_ = nh_.advertise<std_msgs::Float64>("/lazy_traffic_controller/" + name + "/schedule_lag", 1);
         status.data = status.IDLE;
 
+        // Command limits, the period is set by the controller
+        shaper_.setLinearLimits(CMD_MAX_LINEAR_ACC, CMD_MAX_LINEAR_JERK);
+        shaper_.setAngularLimits(CMD_MAX_ANGULAR_ACC, CMD_MAX_ANGULAR_JERK);
+
         // Initialise the marker message
         vel_marker_.header.frame_id = "map";
         vel_marker_.ns = "vel_marker";
@@ -62,9 +93,6 @@ public:
         vel_marker_.scale.z = 0.05;
         vel_marker_.color.a = 1.0; // Don't forget to set the alpha!
         vel_marker_.lifetime = ros::Duration(1.0);
-
-        // Initialise dir model for bfs
-        dir_ = {{-1 , -1}, {-1 , 0}, {-1 , 1}, {0 , -1}, {0 , 1}, {1 , -1}, {1 , 0}, {1 , 1}};
     }
     ~Agent() {}
 
@@ -72,16 +100,37 @@ public:
         pub_status_.publish(status);
     }
     void sendVelocity(RVO::Vector2 vel);
+    // First half of sendVelocity, the command is shaped but not published. False if nothing is to be sent.
+    bool computeCommand(RVO::Vector2 vel, AgentCommand& command);
+    // Zeroes the velocities, the zero command is sent by the next sendVelocity or computeCommand
     void stopAgent(void);
+    // Period at which sendVelocity is called, used to integrate the command limits
+    void setControlPeriod(double dt) { shaper_.setControlPeriod(dt); }
+    // Time the waypoint times of a scheduled path are relative to
+    void startSchedule(const ros::Time& start) { schedule_start_ = start; schedule_lag_ = 0.0; }
+    // Seconds behind the schedule (negative if ahead), as of the last update
+    double scheduleLag(void) const { return schedule_lag_; }
     void clearPath(void);
     void updatePreferredVelocity(void);
     // Function to call reciprocal Velocity Obstacles
-    void invokeRVO(std::unordered_map<std::string, Agent> agent_map, const nav_msgs::OccupancyGrid& new_map);
+    void invokeRVO(const std::unordered_map<std::string, Agent>& agent_map, const InflationLayer& inflation_layer);
+    // True if invokeRVO will run avoidance this tick
+    bool requiresAvoidance(void) const;
+    // Interaction risk found by the last invokeRVO, sets how soon it has to run again.
+    // Agents it may collide with within SCHED_TTC_SAFE are added to closing if given.
+    AgentRisk assessRisk(std::vector<std::string>* closing = nullptr) const;
+    // Static obstacle cache, keyed by map version and the grid cell the agent is in.
+    // Returns true (hit) if the cached obstacles are still valid for this key
+    bool lookupStaticObstacleCache(uint64_t map_version, int cell_x, int cell_y);
+    // Take this agent's static obstacles from the fleet level obstacle pass and cache them
+    void setStaticObstacles(const FleetObstacleIndex& fleet_obstacles, int slot,
+                            uint64_t map_version, int cell_x, int cell_y);
 
     std::string robot_frame_id_;
     //Velocity Obstacle related members
-    std::queue<geometry_msgs::PoseStamped> current_path_;
-    geometry_msgs::TransformStamped current_pose_;
+    AgentPath current_path_;
+    SE2 current_pose_; // Pose in the map frame, converted from TF once per update
+    ros::Time pose_stamp_; // Stamp of the transform current_pose_ came from
     RVO::Vector2 preferred_velocity_;
     RVO::Vector2 current_velocity_;
     RVO::Vector2 rvo_velocity_;
@@ -89,43 +138,63 @@ public:
     bool at_rest;
     bool homing_ = false;
     int goal_type_ = 0;
+    UpdateSchedule update_schedule_; // Planning ticks until avoidance runs again
+    RVO::Vector2 planned_preferred_; // Preferred velocity the last avoidance update planned for
     double goal_threshold_;
     mtg_messages::controller_status status;
 private:
-    void ppProcessLookahead(geometry_msgs::Transform current_pose);
+    void ppProcessLookahead(const SE2& current_pose);
+    double computeLookaheadDistance(double progress);
+    double computeScheduledSpeed(const ros::Time& now);
     bool checkifGoalReached();
     //Function to compute Nearest Neighbors of an agent using euclidian distance
     // Returns true if a chance of collision is detected to trigger repulsion
-    bool computeNearestNeighbors(std::unordered_map<std::string, Agent> agent_map, bool isHoming);
-    void computeStaticObstacles(const nav_msgs::OccupancyGrid& new_map);
-    void staticObstacleBfs(const RVO::Vector2& start, const std::vector<int8_t>& map_data, 
-                            const int& map_width, const int& map_height, 
-                            const float& map_resolution,const geometry_msgs::Point& map_origin);
+    bool computeNearestNeighbors(const std::unordered_map<std::string, Agent>& agent_map, bool isHoming);
+    // Samples where the agent will be over the next horizon seconds if it keeps following its
+    // path into the neighbor's prediction. Returns false if the agent has no path to follow
+    bool predictPath(double horizon, rvo_agent_obstacle_info_s& neighbor) const;
+    void computeStaticObstacles(void);
     RVO::Vector2 getCurrentHeading();
     void publishPreferredVelocityMarker(void);
     void publishVOVelocityMarker(bool flag);
-    void rotateInPlace(void);
+    void startSearchState(int state);
 
     ros::Publisher pub_vel_;
     ros::Publisher pub_status_;
     ros::Publisher vel_marker_pub_;
+    ros::Publisher pub_schedule_lag_;
     ros::NodeHandle nh_;
-    geometry_msgs::TransformStamped lookahead_;
+    RVO::Vector2 lookahead_; // Lookahead point in the map frame
     visualization_msgs::Marker vel_marker_;
+    PurePursuitTracker tracker_;
+    CommandShaper shaper_;
+    ros::Time schedule_start_;
+    double schedule_lag_ = 0.0;
 
     double v_max_;
+    double speed_limit_; // Speed the agent drives at, v_max_ unless tracking a schedule
     double w_max_;
-    double ld_; // Lookahead distance
+    double ld_; // Lookahead distance, adapted every tick
+    double ld_min_; // Bounds on the lookahead distance
+    double ld_max_;
+    double ld_speed_gain_; // Lookahead grows by this many seconds of travel at the current speed
+    double ld_turn_gain_; // Lookahead shrinks by 1/(1 + gain*turning) for the turning (rad) within it
     std::string name_;
 
     // Velocity obstacles related members
     std::vector<rvo_agent_obstacle_info_s> neighbors_list_;
     std::vector<rvo_agent_obstacle_info_s> repulsion_list_;
-    std::vector<std::vector<int>> dir_;
+    std::vector<RVO::Vector2> static_obstacles_;
+
+    // Key of the cached static_obstacles_
+    StaticObstacleCache obstacle_cache_;
+    bool stop_pending_ = false;
 
     // Naren's search behaviour
-    int rot_count_ = 0;
-    int pause_count_ = 0;
+    int search_segment_ = 0; // Rotation segments completed
+    double search_yaw_ = 0.0; // Turned (rad) in the current segment
+    SE2 search_heading_; // Pose the last turn was measured from
+    ros::Time search_state_start_;
     int agent_state_ = TRACKING;
     enum AGENT_STATE {
         TRACKING,
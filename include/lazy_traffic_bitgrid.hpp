@@ -0,0 +1,187 @@
+// Bit-packed occupancy storage for the lazy traffic controller
+
+#ifndef LAZY_TRAFFIC_BITGRID_H
+#define LAZY_TRAFFIC_BITGRID_H
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define BITGRID_BLOCK_COLS (64) // One 64 bit word per block row
+#define BITGRID_BLOCK_ROWS (8)  // 8 words = one 64 byte cache line per block
+#define BITGRID_BLOCK_WORDS (BITGRID_BLOCK_ROWS)
+#define BITGRID_ALIGNMENT (64)
+
+/***
+ * One bit per cell (cell > 0 is occupied), tiled in 64 x 8 cell blocks so that a
+ * block is exactly one cache line. Inside a block word r holds row r and bit c
+ * holds column c. Rows of a block are contiguous, blocks are stored row major.
+ * */
+class BitOccupancyGrid {
+
+public:
+
+    BitOccupancyGrid() : width_(0), height_(0), blocks_x_(0), blocks_y_(0), words_(nullptr, &std::free) {}
+
+    BitOccupancyGrid(const BitOccupancyGrid& other) : BitOccupancyGrid() { *this = other; }
+    BitOccupancyGrid(BitOccupancyGrid&& other) : BitOccupancyGrid() { swap(other); }
+    BitOccupancyGrid& operator=(BitOccupancyGrid&& other) {
+        swap(other);
+        return *this;
+    }
+    BitOccupancyGrid& operator=(const BitOccupancyGrid& other) {
+        if(this != &other) {
+            resize(other.width_, other.height_);
+            if(numWords() > 0)
+                std::memcpy(words_.get(), other.words_.get(), numWords()*sizeof(uint64_t));
+        }
+        return *this;
+    }
+
+    void swap(BitOccupancyGrid& other) {
+        std::swap(width_, other.width_);
+        std::swap(height_, other.height_);
+        std::swap(blocks_x_, other.blocks_x_);
+        std::swap(blocks_y_, other.blocks_y_);
+        std::swap(words_, other.words_);
+    }
+
+    // Allocate a cleared grid
+    void resize(int width, int height) {
+        width_ = width > 0 ? width : 0;
+        height_ = height > 0 ? height : 0;
+        blocks_x_ = (width_ + BITGRID_BLOCK_COLS - 1)/BITGRID_BLOCK_COLS;
+        blocks_y_ = (height_ + BITGRID_BLOCK_ROWS - 1)/BITGRID_BLOCK_ROWS;
+        words_.reset();
+        if(numWords() == 0)
+            return;
+        void* buffer = nullptr;
+        if(posix_memalign(&buffer, BITGRID_ALIGNMENT, numWords()*sizeof(uint64_t)) != 0)
+            throw std::bad_alloc();
+        words_.reset(static_cast<uint64_t*>(buffer));
+        std::memset(words_.get(), 0, numWords()*sizeof(uint64_t));
+    }
+
+    // Pack a row major int8 occupancy grid
+    void build(const std::vector<int8_t>& map_data, int width, int height) {
+        resize(width, height);
+        if(map_data.size() < (size_t)width_*height_)
+            return;
+        for(int y = 0; y < height_; y++) {
+            const int8_t* row = &map_data[(size_t)y*width_];
+            for(int bx = 0; bx < blocks_x_; bx++) {
+                int x0 = bx*BITGRID_BLOCK_COLS;
+                int n = std::min(BITGRID_BLOCK_COLS, width_ - x0);
+                word(bx, y) = packWord(row + x0, n);
+            }
+        }
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int blocksX() const { return blocks_x_; }
+    int blocksY() const { return blocks_y_; }
+    size_t numWords() const { return (size_t)blocks_x_*blocks_y_*BITGRID_BLOCK_WORDS; }
+
+    bool occupied(int x, int y) const {
+        if(x < 0 || x >= width_ || y < 0 || y >= height_)
+            return false;
+        return (word(x/BITGRID_BLOCK_COLS, y) >> (x%BITGRID_BLOCK_COLS)) & 1ULL;
+    }
+
+    void set(int x, int y) {
+        word(x/BITGRID_BLOCK_COLS, y) |= 1ULL << (x%BITGRID_BLOCK_COLS);
+    }
+
+    // Row y of block column bx, bit i is cell (bx*64 + i, y)
+    uint64_t& word(int bx, int y) {
+        return words_.get()[blockOffset(bx, y/BITGRID_BLOCK_ROWS) + y%BITGRID_BLOCK_ROWS];
+    }
+    uint64_t word(int bx, int y) const {
+        return words_.get()[blockOffset(bx, y/BITGRID_BLOCK_ROWS) + y%BITGRID_BLOCK_ROWS];
+    }
+
+    // True if any cell of block (bx, by) is occupied
+    bool blockAny(int bx, int by) const {
+        const uint64_t* block = words_.get() + blockOffset(bx, by);
+        uint64_t acc = 0;
+        for(int r = 0; r < BITGRID_BLOCK_WORDS; r++)
+            acc |= block[r];
+        return acc != 0;
+    }
+
+    // Bits of row y for columns [x0, x0 + 64), cells outside the grid read as free
+    uint64_t rowBits(int x0, int y) const {
+        if(y < 0 || y >= height_ || x0 >= width_ || x0 <= -BITGRID_BLOCK_COLS)
+            return 0;
+        if(x0 < 0)
+            return word(0, y) << (-x0);
+        int bx = x0/BITGRID_BLOCK_COLS;
+        int shift = x0%BITGRID_BLOCK_COLS;
+        uint64_t bits = word(bx, y) >> shift;
+        if(shift != 0 && bx + 1 < blocks_x_)
+            bits |= word(bx + 1, y) << (BITGRID_BLOCK_COLS - shift);
+        return bits;
+    }
+
+    // Half resolution grid where a cell is occupied if any of its 2x2 children is
+    void downsample(BitOccupancyGrid& parent) const {
+        parent.resize((width_ + 1)/2, (height_ + 1)/2);
+        for(int py = 0; py < parent.height_; py++) {
+            int y0 = 2*py;
+            int y1 = std::min(y0 + 1, height_ - 1);
+            for(int bx = 0; bx < blocks_x_; bx++) {
+                uint64_t rows = word(bx, y0) | word(bx, y1);
+                // OR horizontal pairs and gather the even bits into the low 32 bits
+                uint64_t x = (rows | (rows >> 1)) & 0x5555555555555555ULL;
+                x = (x | (x >> 1)) & 0x3333333333333333ULL;
+                x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+                x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+                x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+                x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+                parent.word(bx/2, py) |= x << (32*(bx%2));
+            }
+        }
+    }
+
+private:
+
+    size_t blockOffset(int bx, int by) const {
+        return ((size_t)by*blocks_x_ + bx)*BITGRID_BLOCK_WORDS;
+    }
+
+    // Occupancy bits of n <= 64 consecutive cells
+    static uint64_t packWord(const int8_t* cells, int n) {
+        uint64_t bits = 0;
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for(; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + i));
+            uint64_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, zero));
+            bits |= mask << i;
+        }
+#endif
+        for(; i < n; i++) {
+            if(cells[i] > 0)
+                bits |= 1ULL << i;
+        }
+        return bits;
+    }
+
+    int width_;
+    int height_;
+    int blocks_x_;
+    int blocks_y_;
+    std::unique_ptr<uint64_t, decltype(&std::free)> words_;
+};
+
+#endif // LAZY_TRAFFIC_BITGRID_H
@@ -2,6 +2,18 @@
 #ifndef LAZY_TRAFFIC_CONTROLLER_H
 #define LAZY_TRAFFIC_CONTROLLER_H
 #define NUMBER_OF_PAUSES (3)
+#define CONTROL_LOOP_CPU (-1) // CPU the control loop is pinned to, -1 to let the kernel choose
+#define CONTROL_LOOP_PRIORITY (0) // SCHED_FIFO priority of the control loop, 0 keeps the default scheduler
+#define TIMING_REPORT_PERIOD (1.0) // Period (s) the control loop timing is published at
+#define STAGING_QUEUE_CAPACITY (256) // Path commands and fleet updates waiting for the next tick
+#define USE_ADAPTIVE_UPDATES (1) // Run avoidance for low risk agents less often, holding their last velocity
+#define SCHED_MAX_STALENESS (0.8) // Longest time (s) an agent can hold a velocity without an avoidance update
+#define SCHED_HOLD_TOLERANCE (0.05) // Change (m/s) of the preferred velocity that ends a hold
+#define PIPELINED_CONTROL_TICK (0) // Gather poses, compute commands and publish them on three pipelined threads
+#define PIPELINE_QUEUE_DEPTH (2) // Frames that can wait between two pipeline stages
+#define FLEET_SERVICE_TIMEOUT (2.0) // Time (s) a fleet query waits for the agent bringup service
+#define FLEET_RETRY_MIN (0.5) // First delay (s) before retrying a failed fleet query
+#define FLEET_RETRY_MAX (8.0) // Longest delay (s) between fleet query retries
 
 #include <string>
 #include <cmath>
@@ -9,17 +21,81 @@
 #include <queue>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <future>
 #include<unordered_map>
+#include <map>
 
 #include "mtg_messages/mtg_controller.h"
+#include "mtg_messages/agent_status.h"
+#include "mtg_controller/PathUpdate.h"
+#include "mtg_controller/ControllerTiming.h"
 #include "lazy_traffic_agent.hpp"
+#include "lazy_traffic_timing.hpp"
+#include "lazy_traffic_spsc.hpp"
+#include "lazy_traffic_pipeline.hpp"
 // ROS stuff
 #include <tf/tf.h>
 #include <tf2_ros/transform_listener.h>
 #include <ros/console.h>
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
 #include <std_msgs/Bool.h>
 #include <geometry_msgs/Twist.h>
 
+// Obstacle structures built from one /map message
+struct StaticMap {
+    OccupancyPyramid pyramid;
+    InflationLayer inflation;
+};
+
+// Change to an agent's path staged by the services for the control loop
+struct PathCommand {
+    enum Op { ASSIGN, APPEND, SPLICE, TRUNCATE, STOP_ALL };
+    Op op = ASSIGN;
+    std::string agent_name;
+    AgentPath path;
+    ros::Time stamp; // Schedule start if the path is scheduled, zero for now
+    double splice_s = 0.0;
+    bool homing = false; // No goal type given, new path is a homing task
+    int goal_type = 0;
+    bool has_goal_id = false;
+    mtg_messages::controller_status::_goal_id_type goal_id;
+};
+
+// Timing of one tick, carried through the pipeline stages along with its data
+struct TickTiming {
+    int64_t gathered_ns = 0; // Monotonic time the pose lookups started
+    double jitter = 0.0;
+    uint32_t skipped = 0; // Deadlines skipped before this tick
+    uint32_t dropped = 0; // Pose frames dropped before this one because compute was behind
+    double poses = 0.0;
+    double preferred = 0.0;
+    double obstacles = 0.0;
+    double avoidance = 0.0;
+    uint32_t cache_hits = 0; // Static obstacle cache lookups of the tick
+    uint32_t cache_misses = 0;
+};
+
+struct AgentPose {
+    std::string name;
+    SE2 pose;
+    ros::Time stamp; // Stamp of the transform it came from
+};
+
+// First pipeline stage output, agent poses for one tick
+struct PoseFrame {
+    TickTiming timing;
+    std::vector<AgentPose> poses;
+};
+
+// Second pipeline stage output, the commands computed from one PoseFrame
+struct CommandFrame {
+    TickTiming timing;
+    std::vector<AgentCommand> commands;
+};
+
 /***
  * TODO :
  * Measured velocity for one iteration
@@ -37,23 +113,60 @@ public:
 private:
 
     void RunController(void);
+    void ControlLoop(void);
+    void PoseStage(void);
+    void ComputeStage(void);
+    void PublishStage(void);
+    void configureControlThread(void);
+    void publishTiming(void);
     void statusCallback(const std_msgs::Bool &status_msg);
-    std::set<std::string> getFleetStatusInfo(void);
+    bool getFleetStatusInfo(std::set<std::string>& agents);
     void initialiseAgentMap(std::set<std::string> active_agents);
-    void computeVelocities(const ros::TimerEvent&);
+    void computeVelocities(void);
     void occupancyGridCallback(const nav_msgs::OccupancyGrid &occupancy_grid_msg);
     bool controllerServiceCallback(mtg_messages::mtg_controller::Request &req,
                                    mtg_messages::mtg_controller::Response &res);
+    bool pathUpdateServiceCallback(mtg_controller::PathUpdate::Request &req,
+                                   mtg_controller::PathUpdate::Response &res);
     void updateAgentPoses(void);
+    bool lookupPose(const std::string& frame_id, SE2& pose, ros::Time& stamp);
+    void applyPose(Agent& agent, const SE2& pose, const ros::Time& stamp);
+    AgentPath ingestPath(std::vector<geometry_msgs::PoseStamped>&& poses);
+    void computeFleetObstacles(uint32_t& cache_hits, uint32_t& cache_misses);
+    void planAgent(Agent& agent);
+    void applyStagedUpdates(void);
+    void applyPathCommand(PathCommand& command);
+    void publishAgentFrames(void);
 
     // miscellanous
     std::thread traffic_controller_thread_;
-    bool controller_active_;
-    bool fleet_status_outdated_;
+    std::thread control_loop_thread_;
+    std::thread compute_thread_; // Pipelined tick only, the control loop gathers the poses
+    std::thread publish_thread_;
+    std::atomic<bool> controller_active_;
+    std::atomic<bool> fleet_status_outdated_;
     std::string map_frame_id_;
-    double controller_period_s;
-    double velocity_calc_period_s;
-    std::mutex map_mutex;
+    double controller_period_s; // Command period
+    double velocity_calc_period_s; // Planning (avoidance) period, a multiple of the command period
+    uint32_t plan_every_; // Command ticks per planning tick
+    UpdateScheduler scheduler_;
+    ControlLoopStats timing_; // Only touched by the control loop, or the publish stage of the pipelined tick
+    HandoffQueue<PoseFrame> pose_frames_;
+    HandoffQueue<CommandFrame> command_frames_;
+
+    // Hand off from the callback threads to the control loop. Producers build everything
+    // outside the loop and the loop picks it up at the start of a tick, neither side waits
+    // for the other. Agents, the map in use and active_agents belong to the control loop.
+    std::shared_ptr<StaticMap> staged_map_; // Latest map not yet picked up, atomic access only
+    std::shared_ptr<StaticMap> retired_map_; // Map replaced by the loop, freed by the map thread
+    SpscQueue<PathCommand> path_commands_; // Produced by the service thread only
+    SpscQueue<std::set<std::string>> fleet_updates_; // Produced by the fleet status thread only
+    std::shared_ptr<const std::map<std::string, std::string>> agent_frames_; // Robot frame of every agent known to the loop, atomic access only
+    // Fleet query running on its own thread, owned by the fleet status thread
+    std::future<bool> fleet_call_;
+    std::shared_ptr<mtg_messages::agent_status> fleet_srv_;
+    std::unordered_map<std::string, uint32_t> accepted_seq_; // Service thread only
+    std::unordered_map<std::string, uint32_t> path_generation_; // Full paths staged per agent, service thread only
 
     // controller data structures
     std::unordered_map<std::string, Agent> agent_map_;
@@ -64,12 +177,28 @@ private:
     tf2_ros::TransformListener tf_listener_;
     ros::ServiceClient status_client_; 
     ros::ServiceServer controller_service_;
-    ros::Timer controller_timer_;
+    ros::ServiceServer path_update_service_;
+    ros::Publisher timing_publisher_;
     ros::Subscriber status_subscriber_;
     ros::Subscriber occupancy_grid_subscriber_;
     ros::Subscriber gui_subscriber_;
     ros::NodeHandle nh_;
-    nav_msgs::OccupancyGrid occupancy_grid_map_;
+    // Map updates, fleet status and the services each have their own queue and thread,
+    // so none of them delays the others or the control loop. The service spinner has to
+    // stay single threaded, it is the one producer of path_commands_.
+    ros::CallbackQueue map_queue_;
+    ros::CallbackQueue status_queue_;
+    ros::CallbackQueue service_queue_;
+    ros::NodeHandle map_nh_;
+    ros::NodeHandle status_nh_;
+    ros::NodeHandle service_nh_;
+    ros::AsyncSpinner map_spinner_;
+    ros::AsyncSpinner service_spinner_;
+    OccupancyPyramid occupancy_pyramid_;
+    InflationLayer inflation_layer_;
+    FleetObstacleIndex fleet_obstacles_;
+    uint64_t map_version_;
+    uint64_t tick_count_; // Command ticks run, owned by whichever thread runs the agents
     void processNewAgentStatus(std::set<string> new_fleet_info);
     
 };
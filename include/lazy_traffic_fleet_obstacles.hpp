@@ -0,0 +1,161 @@
+// Fleet level static obstacle extraction for the lazy traffic controller
+
+#ifndef LAZY_TRAFFIC_FLEET_OBSTACLES_H
+#define LAZY_TRAFFIC_FLEET_OBSTACLES_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "Vector2.h"
+#include "lazy_traffic_pyramid.hpp"
+
+/***
+ * Collects the occupied cells within radius of any agent in a single sweep over
+ * the union of their search disks. Every row of the union is read once, 64 cells
+ * at a time, no matter how many disks overlap it. Each agent then gets the
+ * indices of its own obstacles into the shared obstacle list.
+ * Disks the coarse pyramid levels show to be free are rejected before the
+ * sweep, so agents in open space cost one hierarchical query each.
+ * Obstacles are placed at origin + resolution*index, same as the rest of the controller.
+ * */
+class FleetObstacleIndex {
+
+public:
+
+    void build(const OccupancyPyramid& pyramid, const std::vector<RVO::Vector2>& centres, float radius) {
+
+        obstacles_.clear();
+        agent_obstacles_.resize(centres.size());
+        for(auto& indices : agent_obstacles_)
+            indices.clear();
+        if(pyramid.empty() || centres.empty())
+            return;
+
+        const BitOccupancyGrid& grid = pyramid.level(0);
+        const float resolution = pyramid.resolution();
+        const float origin_x = pyramid.originX();
+        const float origin_y = pyramid.originY();
+        const float radius_sq = radius*radius;
+
+        // Rows touched by any disk with an occupied cell in its bounding box
+        candidates_.clear();
+        int row_min = grid.height(), row_max = -1;
+        for(int a = 0; a < (int)centres.size(); a++) {
+            const RVO::Vector2& c = centres[a];
+            int y0 = (int)std::floor((c.y() - radius - origin_y)/resolution);
+            int y1 = (int)std::ceil((c.y() + radius - origin_y)/resolution);
+            if(!pyramid.anyOccupied((int)std::floor((c.x() - radius - origin_x)/resolution), y0,
+                                    (int)std::ceil((c.x() + radius - origin_x)/resolution), y1))
+                continue;
+            candidates_.push_back(a);
+            row_min = std::min(row_min, y0);
+            row_max = std::max(row_max, y1);
+        }
+        row_min = std::max(row_min, 0);
+        row_max = std::min(row_max, grid.height() - 1);
+
+        for(int y = row_min; y <= row_max; y++) {
+
+            // Chord of every disk crossing this row
+            float wy = origin_y + resolution*y;
+            active_.clear();
+            intervals_.clear();
+            for(int a : candidates_) {
+                float dy = wy - centres[a].y();
+                if(dy*dy > radius_sq)
+                    continue;
+                float half = std::sqrt(radius_sq - dy*dy);
+                int xa = std::max((int)std::ceil((centres[a].x() - half - origin_x)/resolution), 0);
+                int xb = std::min((int)std::floor((centres[a].x() + half - origin_x)/resolution), grid.width() - 1);
+                if(xa > xb)
+                    continue;
+                active_.push_back(a);
+                intervals_.push_back(std::make_pair(xa, xb));
+            }
+            if(intervals_.empty())
+                continue;
+
+            // Merge overlapping chords so every cell is read once
+            std::sort(intervals_.begin(), intervals_.end());
+            int merged = 0;
+            for(size_t i = 1; i < intervals_.size(); i++) {
+                if(intervals_[i].first <= intervals_[merged].second + 1)
+                    intervals_[merged].second = std::max(intervals_[merged].second, intervals_[i].second);
+                else
+                    intervals_[++merged] = intervals_[i];
+            }
+            intervals_.resize(merged + 1);
+
+            for(const auto& interval : intervals_) {
+                for(int x0 = interval.first; x0 <= interval.second; x0 += BITGRID_BLOCK_COLS) {
+                    uint64_t bits = grid.rowBits(x0, y);
+                    int n = interval.second - x0 + 1;
+                    if(n < BITGRID_BLOCK_COLS)
+                        bits &= (1ULL << n) - 1;
+                    while(bits) {
+                        int x = x0 + __builtin_ctzll(bits);
+                        bits &= bits - 1;
+                        addObstacle(RVO::Vector2(origin_x + resolution*x, wy), centres, radius_sq);
+                    }
+                }
+            }
+        }
+    }
+
+    size_t numObstacles() const { return obstacles_.size(); }
+    const RVO::Vector2& obstacle(uint32_t index) const { return obstacles_[index]; }
+    // Indices of the obstacles within radius of centre number agent
+    const std::vector<uint32_t>& agentObstacles(int agent) const { return agent_obstacles_[agent]; }
+
+private:
+
+    void addObstacle(const RVO::Vector2& position, const std::vector<RVO::Vector2>& centres, float radius_sq) {
+        uint32_t index = obstacles_.size();
+        obstacles_.push_back(position);
+        for(int a : active_) {
+            if(absSq(position - centres[a]) <= radius_sq)
+                agent_obstacles_[a].push_back(index);
+        }
+    }
+
+    std::vector<RVO::Vector2> obstacles_;
+    std::vector<std::vector<uint32_t>> agent_obstacles_;
+    // Scratch buffers reused across rows and ticks
+    std::vector<int> candidates_;
+    std::vector<int> active_;
+    std::vector<std::pair<int,int>> intervals_;
+};
+
+// Key of an agent's cached static obstacles. They stay valid while the agent is
+// in the same grid cell of the same map, a new map or another cell is a miss.
+struct StaticObstacleCache {
+
+    bool valid = false;
+    uint64_t map_version = 0;
+    int cell_x = 0;
+    int cell_y = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    // True (hit) if the cached obstacles are still valid for this key
+    bool lookup(uint64_t version, int x, int y) {
+        if(valid && map_version == version && cell_x == x && cell_y == y) {
+            hits++;
+            return true;
+        }
+        misses++;
+        return false;
+    }
+
+    // Obstacles were just taken for this key
+    void store(uint64_t version, int x, int y) {
+        valid = true;
+        map_version = version;
+        cell_x = x;
+        cell_y = y;
+    }
+};
+
+#endif // LAZY_TRAFFIC_FLEET_OBSTACLES_H
@@ -0,0 +1,154 @@
+// Inflated static obstacle layer for the lazy traffic controller
+
+#ifndef LAZY_TRAFFIC_INFLATION_H
+#define LAZY_TRAFFIC_INFLATION_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "Vector2.h"
+
+#define INFLATION_INFTY (1e20) // Squared distance used for cells with no obstacle in the row/column
+#define INFLATION_HORIZON_DIST (0.5) // Distance (m) along a candidate velocity that is checked, matches MAX_STATIC_OBS_DIST
+#define INFLATION_TTC_INFTY (9e9f) // Returned when no collision within the horizon, same as RVO_INFTY
+
+/***
+ * Distance field over the occupancy grid, built once per map update.
+ * Each cell stores its clearance : distance (m) to the nearest occupied cell
+ * minus the agent footprint radius. Candidate velocities are checked by sphere
+ * tracing along the trajectory, so the cost per candidate does not depend on
+ * how many occupied cells are around the agent.
+ * Obstacles are placed at origin + resolution*index, same as staticObstacleBfs.
+ * */
+class InflationLayer {
+
+public:
+
+    InflationLayer() : width_(0), height_(0), resolution_(0.0f), origin_x_(0.0f), origin_y_(0.0f), footprint_radius_(0.0f) {}
+
+    // Rebuild the layer from a row major occupancy grid, cells > 0 are obstacles
+    void build(const std::vector<int8_t>& map_data, int width, int height, float resolution,
+               float origin_x, float origin_y, float footprint_radius) {
+
+        width_ = width;
+        height_ = height;
+        resolution_ = resolution;
+        origin_x_ = origin_x;
+        origin_y_ = origin_y;
+        footprint_radius_ = footprint_radius;
+        clearance_.assign(width_*height_, 0.0f);
+        if(width_ <= 0 || height_ <= 0 || map_data.size() < (size_t)(width_*height_))
+            return;
+
+        // Exact euclidean distance transform (Felzenszwalb & Huttenlocher), in cells squared
+        std::vector<double> dist_sq(width_*height_);
+        for(int i = 0; i < width_*height_; i++)
+            dist_sq[i] = map_data[i] > 0 ? 0.0 : INFLATION_INFTY;
+
+        int max_dim = std::max(width_, height_);
+        std::vector<double> f(max_dim), d(max_dim), z(max_dim + 1);
+        std::vector<int> v(max_dim);
+
+        // Columns
+        for(int x = 0; x < width_; x++) {
+            for(int y = 0; y < height_; y++)
+                f[y] = dist_sq[x + y*width_];
+            distanceTransform1D(f, height_, d, v, z);
+            for(int y = 0; y < height_; y++)
+                dist_sq[x + y*width_] = d[y];
+        }
+        // Rows
+        for(int y = 0; y < height_; y++) {
+            for(int x = 0; x < width_; x++)
+                f[x] = dist_sq[x + y*width_];
+            distanceTransform1D(f, width_, d, v, z);
+            for(int x = 0; x < width_; x++)
+                clearance_[x + y*width_] = (float)std::sqrt(d[x])*resolution_ - footprint_radius_;
+        }
+    }
+
+    bool empty() const { return clearance_.empty(); }
+
+    // Clearance (m) at a world position. Outside the map is treated as free space.
+    float clearance(const RVO::Vector2& p) const {
+        int ix = (int)std::floor((p.x() - origin_x_)/resolution_ + 0.5f);
+        int iy = (int)std::floor((p.y() - origin_y_)/resolution_ + 0.5f);
+        if(ix < 0 || ix >= width_ || iy < 0 || iy >= height_)
+            return INFLATION_TTC_INFTY;
+        return clearance_[ix + iy*width_];
+    }
+
+    // Time at which the agent moving from p with velocity vel first enters an inflated cell,
+    // INFLATION_TTC_INFTY if it stays clear for max_dist metres along the trajectory
+    float timeToCollision(const RVO::Vector2& p, const RVO::Vector2& vel, float max_dist = INFLATION_HORIZON_DIST) const {
+
+        if(empty())
+            return INFLATION_TTC_INFTY;
+
+        // Already inside the footprint : shrink the radius like rvoTimeToCollision does,
+        // so the agent is still allowed to move away from the obstacle
+        float radius = footprint_radius_;
+        float start_dist = clearance(p) + footprint_radius_;
+        while(start_dist <= radius && radius > 0.5f*resolution_)
+            radius = radius/2;
+        float offset = footprint_radius_ - radius;
+
+        float speed = abs(vel);
+        if(speed < 1e-6f)
+            return INFLATION_TTC_INFTY;
+        RVO::Vector2 dir = vel/speed;
+
+        // Sphere tracing : clearance is a lower bound on the free distance ahead
+        float travelled = 0.0f;
+        while(travelled <= max_dist) {
+            float c = clearance(p + dir*travelled) + offset;
+            if(c <= 0.0f && travelled > 0.0f)
+                return travelled/speed;
+            travelled += std::max(c, resolution_);
+        }
+        return INFLATION_TTC_INFTY;
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+
+    // 1D squared distance transform of f (lower envelope of parabolas)
+    static void distanceTransform1D(const std::vector<double>& f, int n, std::vector<double>& d,
+                                    std::vector<int>& v, std::vector<double>& z) {
+        int k = 0;
+        v[0] = 0;
+        z[0] = -INFLATION_INFTY;
+        z[1] = INFLATION_INFTY;
+        for(int q = 1; q < n; q++) {
+            double s = ((f[q] + (double)q*q) - (f[v[k]] + (double)v[k]*v[k]))/(2.0*q - 2.0*v[k]);
+            while(s <= z[k]) {
+                k--;
+                s = ((f[q] + (double)q*q) - (f[v[k]] + (double)v[k]*v[k]))/(2.0*q - 2.0*v[k]);
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k+1] = INFLATION_INFTY;
+        }
+        k = 0;
+        for(int q = 0; q < n; q++) {
+            while(z[k+1] < q)
+                k++;
+            d[q] = (double)(q - v[k])*(q - v[k]) + f[v[k]];
+        }
+    }
+
+    int width_;
+    int height_;
+    float resolution_;
+    float origin_x_;
+    float origin_y_;
+    float footprint_radius_;
+    std::vector<float> clearance_;
+};
+
+#endif // LAZY_TRAFFIC_INFLATION_H
@@ -0,0 +1,331 @@
+// Compact path representation for the lazy traffic controller
+
+#ifndef LAZY_TRAFFIC_PATH_H
+#define LAZY_TRAFFIC_PATH_H
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include "Vector2.h"
+
+#define PATH_PROJECTION_BEHIND (0.5) // Arc length (m) behind the current progress searched when projecting
+#define PATH_PROJECTION_AHEAD (1.5) // Arc length (m) ahead of the current progress searched when projecting
+#define PATH_SIMPLIFY_TOLERANCE (0.02) // Max distance (m) between an ingested path and its simplified version
+#define PATH_SIMPLIFY_TIME_TOLERANCE (0.05) // Max difference (s) between an ingested schedule and its simplified version
+
+/***
+ * Contiguous array of 2D waypoints with their cumulative arc length, plus a
+ * cursor that only moves forward. Waypoints behind the cursor are kept, so
+ * advancing is O(1) and nothing is copied or freed while tracking. size(),
+ * front() and pop() behave like the std::queue that used to hold the path,
+ * i.e. they only see the remaining part.
+ * The absolute heading change at every waypoint is also accumulated, so the
+ * total turning (integrated curvature) over any arc length window is O(log n).
+ * Waypoints can carry a time (s, relative to the start of the schedule) from a
+ * planner. The path counts as scheduled if the times are non decreasing and not
+ * all zero, the schedule is then interpolated linearly in arc length.
+ * Paths can be extended, spliced and truncated in place. Everything up to the
+ * edit is kept, so the cursor and progress carry over unless they lie past it.
+ * The robot is tracked by its arc length progress, which is found by projecting
+ * it onto the segments in a window around the previous progress. The window
+ * reaches behind the progress so a robot pushed backwards by avoidance is not lost.
+ * */
+class AgentPath {
+
+public:
+
+    AgentPath() : cursor_(0), progress_(0.0), monotonic_(true) {}
+
+    void reserve(size_t n) {
+        points_.reserve(n);
+        arc_length_.reserve(n);
+        turn_prefix_.reserve(n + 1);
+        times_.reserve(n);
+    }
+    void push_back(const RVO::Vector2& point, double time = 0.0) {
+        if(!times_.empty() && time < times_.back())
+            monotonic_ = false;
+        times_.push_back(time);
+        arc_length_.push_back(points_.empty() ? 0.0 : arc_length_.back() + abs(point - points_.back()));
+        if(turn_prefix_.empty())
+            turn_prefix_.push_back(0.0);
+        // The previous waypoint now has a segment on both sides, add its heading change
+        size_t n = points_.size();
+        if(n >= 2) {
+            RVO::Vector2 in = points_[n-1] - points_[n-2];
+            RVO::Vector2 out = point - points_[n-1];
+            if(absSq(in) > 0.0f && absSq(out) > 0.0f)
+                turn_prefix_.back() += std::fabs(std::atan2(det(in, out), in*out));
+        }
+        turn_prefix_.push_back(turn_prefix_.back());
+        points_.push_back(point);
+    }
+    void clear() {
+        points_.clear();
+        arc_length_.clear();
+        turn_prefix_.clear();
+        times_.clear();
+        cursor_ = 0;
+        progress_ = 0.0;
+        monotonic_ = true;
+    }
+    void swap(AgentPath& other) {
+        points_.swap(other.points_);
+        arc_length_.swap(other.arc_length_);
+        turn_prefix_.swap(other.turn_prefix_);
+        times_.swap(other.times_);
+        std::swap(cursor_, other.cursor_);
+        std::swap(progress_, other.progress_);
+        std::swap(monotonic_, other.monotonic_);
+    }
+
+    // Add all waypoints of tail after the last one
+    void append(const AgentPath& tail) {
+        reserve(points_.size() + tail.points_.size());
+        for(size_t i = 0; i < tail.points_.size(); i++)
+            push_back(tail.points_[i], tail.times_[i]);
+    }
+
+    // Drop the path after arc length s, ending it with the point at s
+    void truncateAt(double s) {
+        if(points_.empty())
+            return;
+        s = std::max(s, 0.0);
+        if(s >= length())
+            return;
+        size_t i = segmentAt(s);
+        RVO::Vector2 end = pointAt(s);
+        double end_time = interpolate(arc_length_, times_, s);
+        resizeTo(i + 1);
+        if(s > arc_length_[i])
+            push_back(end, end_time);
+        cursor_ = std::min(cursor_, points_.size() - 1);
+        progress_ = std::min(progress_, length());
+    }
+
+    // Replace the path after arc length s by tail
+    void spliceAt(double s, const AgentPath& tail) {
+        truncateAt(s);
+        append(tail);
+    }
+
+    // Remaining waypoints, from the cursor to the end
+    bool empty() const { return cursor_ >= points_.size(); }
+    size_t size() const { return empty() ? 0 : points_.size() - cursor_; }
+    const RVO::Vector2& front() const { return points_[cursor_]; }
+    const RVO::Vector2& back() const { return points_.back(); }
+    void pop() { cursor_++; }
+
+    // Absolute indexing over the whole path
+    size_t cursor() const { return cursor_; }
+    size_t totalSize() const { return points_.size(); }
+    const RVO::Vector2& operator[](size_t index) const { return points_[index]; }
+    void advanceTo(size_t index) {
+        if(index > cursor_)
+            cursor_ = index;
+    }
+
+    // Total arc length and arc length at a waypoint
+    double length() const { return arc_length_.empty() ? 0.0 : arc_length_.back(); }
+    double arcLength(size_t index) const { return arc_length_[index]; }
+    double progress() const { return progress_; }
+
+    // Index i of the segment [i, i+1] containing arc length s, clamped to the path
+    size_t segmentAt(double s) const {
+        if(points_.size() < 2)
+            return 0;
+        size_t index = std::upper_bound(arc_length_.begin(), arc_length_.end(), s) - arc_length_.begin();
+        return std::min(index == 0 ? 0 : index - 1, points_.size() - 2);
+    }
+
+    // Total absolute heading change (rad) at the waypoints with arc length in (s_from, s_to]
+    double turning(double s_from, double s_to) const {
+        if(points_.size() < 3 || s_to <= s_from)
+            return 0.0;
+        size_t first = std::upper_bound(arc_length_.begin(), arc_length_.end(), s_from) - arc_length_.begin();
+        size_t last = std::upper_bound(arc_length_.begin(), arc_length_.end(), s_to) - arc_length_.begin();
+        return turn_prefix_[last] - turn_prefix_[first];
+    }
+
+    // Point at arc length s, interpolated between waypoints and clamped to the path ends
+    RVO::Vector2 pointAt(double s) const {
+        if(points_.size() < 2)
+            return points_.empty() ? RVO::Vector2() : points_[0];
+        size_t i = segmentAt(s);
+        double segment_length = arc_length_[i+1] - arc_length_[i];
+        double t = segment_length > 0.0 ? (s - arc_length_[i])/segment_length : 0.0;
+        t = std::min(std::max(t, 0.0), 1.0);
+        return points_[i] + (points_[i+1] - points_[i])*(float)t;
+    }
+
+    // Schedule, times are relative to the start of the schedule
+    bool scheduled() const { return monotonic_ && !times_.empty() && times_.back() > 0.0; }
+    double time(size_t index) const { return times_[index]; }
+
+    // Arc length the schedule expects at time t, clamped to the path ends
+    double scheduledArcLength(double t) const {
+        return interpolate(times_, arc_length_, t);
+    }
+    // Time the schedule expects the robot at arc length s
+    double scheduledTime(double s) const {
+        return interpolate(arc_length_, times_, s);
+    }
+    // Planned speed at time t, zero while the schedule waits or once it is over
+    double scheduledSpeed(double t) const {
+        if(points_.size() < 2 || t < times_.front() || t >= times_.back())
+            return 0.0;
+        size_t i = std::upper_bound(times_.begin(), times_.end(), t) - times_.begin() - 1;
+        double duration = times_[i+1] - times_[i];
+        return duration > 0.0 ? (arc_length_[i+1] - arc_length_[i])/duration : 0.0;
+    }
+
+    // Project position onto the path around the current progress, update the progress and
+    // move the cursor up to the projected segment. Returns the new progress.
+    double track(const RVO::Vector2& position) {
+        if(points_.size() < 2) {
+            progress_ = 0.0;
+            return progress_;
+        }
+        size_t first = segmentAt(progress_ - PATH_PROJECTION_BEHIND);
+        size_t last = segmentAt(progress_ + PATH_PROJECTION_AHEAD);
+        float min_dist_sq = INFINITY;
+        size_t best_segment = first;
+        double best_s = progress_;
+        for(size_t i = first; i <= last; i++) {
+            RVO::Vector2 ab = points_[i+1] - points_[i];
+            float length_sq = absSq(ab);
+            float t = length_sq > 0.0f ? ((position - points_[i])*ab)/length_sq : 0.0f;
+            t = std::min(std::max(t, 0.0f), 1.0f);
+            float dist_sq = absSq(position - (points_[i] + ab*t));
+            if(dist_sq < min_dist_sq) {
+                min_dist_sq = dist_sq;
+                best_segment = i;
+                best_s = arc_length_[i] + t*(arc_length_[i+1] - arc_length_[i]);
+            }
+        }
+        progress_ = best_s;
+        advanceTo(best_segment);
+        return progress_;
+    }
+
+private:
+
+    // Keep the first n waypoints, the last one loses its heading change
+    void resizeTo(size_t n) {
+        points_.resize(n);
+        arc_length_.resize(n);
+        times_.resize(n);
+        turn_prefix_.resize(n + 1);
+        if(n > 0)
+            turn_prefix_[n] = turn_prefix_[n-1];
+        monotonic_ = std::is_sorted(times_.begin(), times_.end());
+    }
+
+    // Piecewise linear y(x) for non decreasing xs, clamped to the ends
+    static double interpolate(const std::vector<double>& xs, const std::vector<double>& ys, double x) {
+        if(xs.empty())
+            return 0.0;
+        size_t i = std::upper_bound(xs.begin(), xs.end(), x) - xs.begin();
+        if(i == 0)
+            return ys.front();
+        if(i == xs.size())
+            return ys.back();
+        double dx = xs[i] - xs[i-1];
+        double t = dx > 0.0 ? (x - xs[i-1])/dx : 1.0;
+        return ys[i-1] + t*(ys[i] - ys[i-1]);
+    }
+
+    std::vector<RVO::Vector2> points_;
+    std::vector<double> arc_length_;
+    // turn_prefix_[i] is the heading change summed over waypoints 0 .. i-1
+    std::vector<double> turn_prefix_;
+    std::vector<double> times_;
+    size_t cursor_;
+    double progress_;
+    bool monotonic_;
+};
+
+// Distance from p to the segment [a, b]
+inline float distanceToSegment(const RVO::Vector2& p, const RVO::Vector2& a, const RVO::Vector2& b) {
+    RVO::Vector2 ab = b - a;
+    float length_sq = absSq(ab);
+    float t = length_sq > 0.0f ? ((p - a)*ab)/length_sq : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return abs(p - (a + ab*t));
+}
+
+// Ramer-Douglas-Peucker simplification. Returns the indices of the points to keep,
+// every dropped point is within tolerance of the kept polyline. Distances are to
+// segments rather than lines, so paths that double back on themselves are kept.
+// With times, a dropped point must also be within time_tolerance of the time
+// interpolated in arc length between the kept points around it, so waits and
+// speed changes of a schedule survive on straight runs.
+inline std::vector<size_t> simplifyPolyline(const std::vector<RVO::Vector2>& points, float tolerance,
+                                            const std::vector<double>& times = std::vector<double>(),
+                                            double time_tolerance = PATH_SIMPLIFY_TIME_TOLERANCE) {
+
+    std::vector<size_t> kept;
+    if(points.size() < 3) {
+        for(size_t i = 0; i < points.size(); i++)
+            kept.push_back(i);
+        return kept;
+    }
+
+    bool timed = times.size() == points.size();
+    std::vector<double> arc_length(points.size(), 0.0);
+    for(size_t i = 1; i < points.size(); i++)
+        arc_length[i] = arc_length[i-1] + abs(points[i] - points[i-1]);
+
+    std::vector<char> keep(points.size(), 0);
+    keep.front() = 1;
+    keep.back() = 1;
+    std::vector<std::pair<size_t,size_t>> stack;
+    stack.push_back(std::make_pair(0, points.size() - 1));
+    while(!stack.empty()) {
+        size_t first = stack.back().first;
+        size_t last = stack.back().second;
+        stack.pop_back();
+        // Both errors relative to their tolerance, above 1 the point has to stay
+        double max_error = -1.0;
+        size_t farthest = first;
+        double length = arc_length[last] - arc_length[first];
+        for(size_t i = first + 1; i < last; i++) {
+            double error = distanceToSegment(points[i], points[first], points[last])/tolerance;
+            // A run that does not move only waits, any time within it is on schedule
+            if(timed && length > 0.0) {
+                double expected = times[first] + (times[last] - times[first])*(arc_length[i] - arc_length[first])/length;
+                error = std::max(error, std::fabs(times[i] - expected)/time_tolerance);
+            }
+            if(error > max_error) {
+                max_error = error;
+                farthest = i;
+            }
+        }
+        if(max_error > 1.0) {
+            keep[farthest] = 1;
+            stack.push_back(std::make_pair(first, farthest));
+            stack.push_back(std::make_pair(farthest, last));
+        }
+    }
+
+    for(size_t i = 0; i < points.size(); i++) {
+        if(keep[i])
+            kept.push_back(i);
+    }
+    return kept;
+}
+
+// Path of the simplified waypoints with their times
+inline AgentPath simplifiedPath(const std::vector<RVO::Vector2>& points, const std::vector<double>& times) {
+
+    std::vector<size_t> kept = simplifyPolyline(points, PATH_SIMPLIFY_TOLERANCE, times);
+    AgentPath path;
+    path.reserve(kept.size());
+    for(size_t index : kept)
+        path.push_back(points[index], times[index]);
+    return path;
+}
+
+#endif // LAZY_TRAFFIC_PATH_H
@@ -0,0 +1,52 @@
+// Bounded hand off between the stages of the pipelined control tick
+
+#ifndef LAZY_TRAFFIC_PIPELINE_H
+#define LAZY_TRAFFIC_PIPELINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "lazy_traffic_spsc.hpp"
+
+/***
+ * SpscQueue with a waiting pop, for a stage that has nothing to do until the
+ * stage before it hands over. The producer never waits : a full queue means
+ * the consumer is behind and push fails, the producer decides what to drop.
+ * The mutex is only taken to sleep and to wake the consumer up.
+ * */
+template<class T>
+class HandoffQueue {
+
+public:
+
+    explicit HandoffQueue(size_t capacity) : queue_(capacity) {}
+
+    bool push(T&& item) {
+        if(!queue_.push(std::move(item)))
+            return false;
+        // Taking the mutex orders the push before a consumer that is about to wait
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        ready_.notify_one();
+        return true;
+    }
+
+    // Waits up to timeout (s) for an item, false if none arrived
+    bool pop(T& item, double timeout) {
+        if(queue_.pop(item))
+            return true;
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait_for(lock, std::chrono::duration<double>(timeout), [this]() { return !queue_.empty(); });
+        return queue_.pop(item);
+    }
+
+    size_t capacity() const { return queue_.capacity(); }
+
+private:
+
+    SpscQueue<T> queue_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
+
+#endif // LAZY_TRAFFIC_PIPELINE_H
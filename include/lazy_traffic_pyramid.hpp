@@ -0,0 +1,162 @@
+// Max-occupancy pyramid for hierarchical static obstacle queries
+
+#ifndef LAZY_TRAFFIC_PYRAMID_H
+#define LAZY_TRAFFIC_PYRAMID_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "Vector2.h"
+#include "lazy_traffic_bitgrid.hpp"
+
+/***
+ * Level 0 holds one bit per map cell (cell > 0 is occupied), every level above
+ * halves the resolution and stores the max of its 2x2 children. All levels are
+ * bit-packed, so the whole pyramid takes about a sixth of the int8 map.
+ * Queries start at the coarsest level that covers the search box with a couple
+ * of cells and only descend into occupied cells, so free and unknown space is
+ * rejected early.
+ * Obstacles are placed at origin + resolution*index, same as the rest of the controller.
+ * */
+class OccupancyPyramid {
+
+public:
+
+    OccupancyPyramid() : resolution_(0.0f), origin_x_(0.0f), origin_y_(0.0f) {}
+
+    void build(const std::vector<int8_t>& map_data, int width, int height, float resolution,
+               float origin_x, float origin_y) {
+
+        resolution_ = resolution;
+        origin_x_ = origin_x;
+        origin_y_ = origin_y;
+        levels_.clear();
+        if(width <= 0 || height <= 0 || map_data.size() < (size_t)(width*height))
+            return;
+
+        levels_.resize(1);
+        levels_[0].build(map_data, width, height);
+
+        // Keep halving until a single cell covers the whole map
+        while(levels_.back().width() > 1 || levels_.back().height() > 1) {
+            BitOccupancyGrid parent;
+            levels_.back().downsample(parent);
+            levels_.push_back(std::move(parent));
+        }
+    }
+
+    bool empty() const { return levels_.empty(); }
+    int numLevels() const { return levels_.size(); }
+
+    bool occupied(int level, int ix, int iy) const {
+        return levels_[level].occupied(ix, iy);
+    }
+
+    const BitOccupancyGrid& level(int level) const { return levels_[level]; }
+    float resolution() const { return resolution_; }
+    float originX() const { return origin_x_; }
+    float originY() const { return origin_y_; }
+
+    // True if any cell in the inclusive index box [x0,x1] x [y0,y1] is occupied
+    bool anyOccupied(int x0, int y0, int x1, int y1) const {
+        if(empty() || !clipBox(x0, y0, x1, y1))
+            return false;
+        int level = startLevel(x0, y0, x1, y1);
+        for(int py = y0 >> level; py <= (y1 >> level); py++) {
+            for(int px = x0 >> level; px <= (x1 >> level); px++) {
+                if(anyOccupiedNode(level, px, py, x0, y0, x1, y1))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // Append the world positions of all occupied cells within radius of centre
+    void collectOccupied(const RVO::Vector2& centre, float radius, std::vector<RVO::Vector2>& out) const {
+        if(empty())
+            return;
+        int x0 = (int)std::floor((centre.x() - radius - origin_x_)/resolution_);
+        int y0 = (int)std::floor((centre.y() - radius - origin_y_)/resolution_);
+        int x1 = (int)std::ceil((centre.x() + radius - origin_x_)/resolution_);
+        int y1 = (int)std::ceil((centre.y() + radius - origin_y_)/resolution_);
+        if(!clipBox(x0, y0, x1, y1))
+            return;
+        int level = startLevel(x0, y0, x1, y1);
+        for(int py = y0 >> level; py <= (y1 >> level); py++) {
+            for(int px = x0 >> level; px <= (x1 >> level); px++)
+                collectNode(level, px, py, x0, y0, x1, y1, centre, radius, out);
+        }
+    }
+
+private:
+
+    bool clipBox(int& x0, int& y0, int& x1, int& y1) const {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, levels_[0].width() - 1);
+        y1 = std::min(y1, levels_[0].height() - 1);
+        return x0 <= x1 && y0 <= y1;
+    }
+
+    // Coarsest level at which the box spans at most two cells per axis
+    int startLevel(int x0, int y0, int x1, int y1) const {
+        int extent = std::max(x1 - x0, y1 - y0) + 1;
+        int level = 0;
+        while((1 << level) < extent && level < numLevels() - 1)
+            level++;
+        return level;
+    }
+
+    bool anyOccupiedNode(int level, int px, int py, int x0, int y0, int x1, int y1) const {
+        if(!occupied(level, px, py))
+            return false;
+        int bx0 = px << level, by0 = py << level;
+        int bx1 = bx0 + (1 << level) - 1, by1 = by0 + (1 << level) - 1;
+        if(bx1 < x0 || bx0 > x1 || by1 < y0 || by0 > y1)
+            return false;
+        // Node fully inside the box, its flag is the answer
+        if(level == 0 || (bx0 >= x0 && bx1 <= x1 && by0 >= y0 && by1 <= y1))
+            return true;
+        for(int c = 0; c < 4; c++) {
+            if(anyOccupiedNode(level - 1, 2*px + (c & 1), 2*py + (c >> 1), x0, y0, x1, y1))
+                return true;
+        }
+        return false;
+    }
+
+    void collectNode(int level, int px, int py, int x0, int y0, int x1, int y1,
+                     const RVO::Vector2& centre, float radius, std::vector<RVO::Vector2>& out) const {
+        if(!occupied(level, px, py))
+            return;
+        int bx0 = px << level, by0 = py << level;
+        int bx1 = bx0 + (1 << level) - 1, by1 = by0 + (1 << level) - 1;
+        if(bx1 < x0 || bx0 > x1 || by1 < y0 || by0 > y1)
+            return;
+        if(level == 0) {
+            RVO::Vector2 position(origin_x_ + resolution_*(float)px, origin_y_ + resolution_*(float)py);
+            if(euclideanDistSq(position, centre) <= radius*radius)
+                out.push_back(position);
+            return;
+        }
+        // Reject nodes whose extent does not touch the disk
+        float dx = std::max(std::max(origin_x_ + resolution_*bx0 - centre.x(), centre.x() - (origin_x_ + resolution_*bx1)), 0.0f);
+        float dy = std::max(std::max(origin_y_ + resolution_*by0 - centre.y(), centre.y() - (origin_y_ + resolution_*by1)), 0.0f);
+        if(dx*dx + dy*dy > radius*radius)
+            return;
+        for(int c = 0; c < 4; c++)
+            collectNode(level - 1, 2*px + (c & 1), 2*py + (c >> 1), x0, y0, x1, y1, centre, radius, out);
+    }
+
+    static float euclideanDistSq(const RVO::Vector2& a, const RVO::Vector2& b) {
+        return (a.x() - b.x())*(a.x() - b.x()) + (a.y() - b.y())*(a.y() - b.y());
+    }
+
+    float resolution_;
+    float origin_x_;
+    float origin_y_;
+    std::vector<BitOccupancyGrid> levels_;
+};
+
+#endif // LAZY_TRAFFIC_PYRAMID_H
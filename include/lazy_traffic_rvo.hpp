@@ -5,6 +5,7 @@
 
 //A class that operates on 2D
 #include "Vector2.h"
+#include "lazy_traffic_inflation.hpp"
 #include <queue>
 #include <map>
 #include <unordered_map>
@@ -17,6 +18,7 @@
 #define TIME_STEP (1) //frequence at which controller runs ( 1/ timestep)
 #define RVO_SAFETY_FACTOR (20.0f) //The safety factor of the agent (weight for penalizing candidate velocities - the higher the safety factor, the less 'aggressive' an agent is)
 #define RVO_INFTY (9e9f)
+#define PREDICTION_SAMPLES (4) // Samples of a neighbor's path over the prediction horizon
 
 typedef std::pair<std::string, float> AgentDistPair;
 
@@ -27,6 +29,12 @@ typedef struct rvo_agent_obstacle_info {
   RVO::Vector2 current_position;
   double max_vel;
   bool homing = false;
+  // Where the neighbor is expected along its path, predicted_path[k] is k*prediction_dt s
+  // from now. predicted_velocity is the velocity it leaves its current position with.
+  RVO::Vector2 predicted_path[PREDICTION_SAMPLES + 1];
+  float prediction_dt = 0.0f;
+  RVO::Vector2 predicted_velocity;
+  bool has_prediction = false;
 } rvo_agent_obstacle_info_s;
 
 
@@ -88,9 +96,27 @@ inline bool AreSameOrLess(double a, double b)
   }
 
 
+// Time for an agent at p moving at v to come within radius of a neighbor that follows its
+// predicted path, linear between the samples and at the last sample's velocity after them
+inline float rvoPredictedTimeToCollision(const RVO::Vector2& p, const RVO::Vector2& v,
+                                         const rvo_agent_obstacle_info_s& n, float radius) {
+
+    float start = 0.0f;
+    for(int k = 0; k < PREDICTION_SAMPLES; k++) {
+        RVO::Vector2 vel_b = (n.predicted_path[k+1] - n.predicted_path[k]) / n.prediction_dt;
+        float time = rvoTimeToCollision(p + v*start, v - vel_b, n.predicted_path[k], radius, false);
+        if(time < RVO_INFTY && (k + 1 == PREDICTION_SAMPLES || time <= n.prediction_dt))
+            return start + time;
+        start += n.prediction_dt;
+    }
+    return RVO_INFTY;
+}
+
 //Function to compute New Velocity using Reciprocal Velocity obstacles
+//If static_layer is given, static obstacles are checked against it instead of being passed as neighbors
 inline RVO::Vector2 rvoComputeNewVelocity(rvo_agent_obstacle_info_s ego_agent_info, 
-                                   const std::vector<rvo_agent_obstacle_info_s>& neighbors_list, bool isHoming) {
+                                   const std::vector<rvo_agent_obstacle_info_s>& neighbors_list, bool isHoming,
+                                   const InflationLayer* static_layer = nullptr) {
     
     //ROS_INFO(" ");
     //ROS_INFO(" ");
@@ -142,16 +168,19 @@ inline RVO::Vector2 rvoComputeNewVelocity(rvo_agent_obstacle_info_s ego_agent_in
             // Change code accordingly
             float t_to_collision; // time to collision with neighbor
             RVO::Vector2 vel_a_to_b;
-            RVO::Vector2 vel_b = n.currrent_velocity;
+            // Where the neighbor is going along its path beats its last measured velocity
+            RVO::Vector2 vel_b = n.has_prediction ? n.predicted_velocity : n.currrent_velocity;
             vel_a_to_b = vel_cand - vel_b;
             RVO::Vector2 neigh_pos = n.current_position;
             float time;
             //If homing or if neighbour is at rest/searching, reduce clearance radius to avoid deadlock
-            if(isHoming || (AreSame(vel_b.x(),0.0)&& AreSame(vel_b.y(),0.0))){
-              time = rvoTimeToCollision(pos_curr, vel_a_to_b, neigh_pos, RVO_RADIUS_MULT_FACTOR_HOMING*RVO_AGENT_RADIUS, is_collision);
-            }else{
-              time = rvoTimeToCollision(pos_curr, vel_a_to_b, neigh_pos, RVO_RADIUS_MULT_FACTOR*RVO_AGENT_RADIUS, is_collision);
-            }
+            float radius = RVO_RADIUS_MULT_FACTOR*RVO_AGENT_RADIUS;
+            if(isHoming || (AreSame(vel_b.x(),0.0)&& AreSame(vel_b.y(),0.0)))
+              radius = RVO_RADIUS_MULT_FACTOR_HOMING*RVO_AGENT_RADIUS;
+            if(n.has_prediction)
+              time = rvoPredictedTimeToCollision(pos_curr, vel_cand, n, radius);
+            else
+              time = rvoTimeToCollision(pos_curr, vel_a_to_b, neigh_pos, radius, is_collision);
             if(is_collision)  {
                 t_to_collision = -std::ceil(time / TIME_STEP);
                 t_to_collision -= absSq(vel_cand) / (ego_agent_info.max_vel*ego_agent_info.max_vel);
@@ -168,6 +197,14 @@ inline RVO::Vector2 rvoComputeNewVelocity(rvo_agent_obstacle_info_s ego_agent_in
                     break;
             }
         }
+
+        // Static obstacles, only if this sample can still beat the best one
+        if(static_layer != nullptr &&
+           RVO_SAFETY_FACTOR / min_t_to_collision + dist_to_pref_vel + dist_to_cur_vel < min_penalty) {
+            float t_static = static_layer->timeToCollision(pos_curr, vel_cand);
+            if(t_static < min_t_to_collision)
+                min_t_to_collision = t_static;
+        }
         float penalty = RVO_SAFETY_FACTOR / min_t_to_collision + dist_to_pref_vel + dist_to_cur_vel;
         if(penalty < min_penalty)
         {
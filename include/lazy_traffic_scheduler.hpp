@@ -0,0 +1,72 @@
+// Per agent avoidance update rates for the lazy traffic controller
+
+#ifndef LAZY_TRAFFIC_SCHEDULER_H
+#define LAZY_TRAFFIC_SCHEDULER_H
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#define SCHED_TTC_RISK (2.0) // Time to collision (s) at and below which an agent is updated every tick
+#define SCHED_TTC_SAFE (8.0) // Time to collision (s) from which it does not matter anymore
+#define SCHED_DENSITY_RISK (3) // Neighbors at which an agent is updated every tick
+#define SCHED_TRACKING_RISK (0.3) // Distance (m) from its path at which an agent is updated every tick
+
+// What an agent's last avoidance update found
+struct AgentRisk {
+    double ttc = INFINITY; // Closest time to collision with a neighbor, 0 when already too close
+    int neighbors = 0;
+    double tracking_error = 0.0; // Distance from the path
+};
+
+// Update state of one agent, in planning ticks
+struct UpdateSchedule {
+
+    uint32_t interval = 1;
+    uint32_t age = 0; // Ticks since the last update
+
+    // Moves on by one tick, true if the agent is due for an update in it
+    bool tick() { return ++age >= interval; }
+
+    void updated(uint32_t next_interval) {
+        age = 0;
+        interval = next_interval;
+    }
+
+    // Makes the agent due in the next tick, e.g. when a neighbor found it closing in
+    void wake() { interval = std::min<uint32_t>(interval, age + 1); }
+};
+
+/***
+ * Maps an agent's risk to the number of planning ticks until its next update.
+ * Each input gives a risk between 0 and 1 : time to collision between the safe
+ * and the risky TTC, neighbors up to the risky density and the tracking error
+ * up to the risky distance. The highest one decides, risk 1 means every tick
+ * and risk 0 the longest interval, which bounds how stale a command can get.
+ * */
+class UpdateScheduler {
+
+public:
+
+    explicit UpdateScheduler(uint32_t max_interval = 1) : max_interval_(std::max<uint32_t>(1, max_interval)) {}
+
+    uint32_t maxInterval() const { return max_interval_; }
+
+    static double risk(const AgentRisk& agent) {
+        double ttc_risk = (SCHED_TTC_SAFE - agent.ttc)/(SCHED_TTC_SAFE - SCHED_TTC_RISK);
+        double density_risk = agent.neighbors/(double)SCHED_DENSITY_RISK;
+        double tracking_risk = agent.tracking_error/SCHED_TRACKING_RISK;
+        double risk = std::max(ttc_risk, std::max(density_risk, tracking_risk));
+        return std::min(std::max(risk, 0.0), 1.0);
+    }
+
+    uint32_t interval(const AgentRisk& agent) const {
+        return 1 + (uint32_t)std::lround((1.0 - risk(agent))*(max_interval_ - 1));
+    }
+
+private:
+
+    uint32_t max_interval_;
+};
+
+#endif // LAZY_TRAFFIC_SCHEDULER_H
@@ -0,0 +1,106 @@
+// Acceleration and jerk limited velocity commands for the lazy traffic controller
+
+#ifndef LAZY_TRAFFIC_SHAPER_H
+#define LAZY_TRAFFIC_SHAPER_H
+
+#include <cmath>
+#include <algorithm>
+
+#define SHAPER_REST_EPSILON (1e-3) // Commands below this are treated as zero
+
+/***
+ * Rate limiter for one velocity axis. Every step the acceleration moves towards
+ * the one that reaches the target this step, by at most jerk*dt, and is clamped
+ * to the acceleration limit. It is also capped at sqrt(2*jerk*error) so it can
+ * ramp back to zero by the time the target is reached, and the velocity is
+ * clamped to the target if a step still overshoots.
+ * */
+class AxisShaper {
+
+public:
+
+    AxisShaper() : max_acc_(INFINITY), max_jerk_(INFINITY), velocity_(0.0), acceleration_(0.0) {}
+
+    void setLimits(double max_acc, double max_jerk) {
+        max_acc_ = max_acc;
+        max_jerk_ = max_jerk;
+    }
+
+    double step(double target, double dt) {
+        if(dt <= 0.0)
+            return velocity_;
+        double error = target - velocity_;
+        double desired = std::min(std::fabs(error)/dt, max_acc_);
+        desired = std::min(desired, std::sqrt(2.0*max_jerk_*std::fabs(error)));
+        desired = std::copysign(desired, error);
+        acceleration_ = std::min(std::max(desired, acceleration_ - max_jerk_*dt), acceleration_ + max_jerk_*dt);
+        acceleration_ = std::min(std::max(acceleration_, -max_acc_), max_acc_);
+        velocity_ += acceleration_*dt;
+        if((target - velocity_)*error < 0.0) {
+            velocity_ = target;
+            acceleration_ = 0.0;
+        }
+        return velocity_;
+    }
+
+    void reset(double velocity = 0.0) {
+        velocity_ = velocity;
+        acceleration_ = 0.0;
+    }
+
+    double velocity() const { return velocity_; }
+    double acceleration() const { return acceleration_; }
+
+private:
+
+    double max_acc_;
+    double max_jerk_;
+    double velocity_;
+    double acceleration_;
+};
+
+/***
+ * Shapes the (linear, angular) command of a differential drive robot so both
+ * axes respect their acceleration and jerk limits, integrated over the period
+ * the commands are sent at. The shaper assumes the robot follows its commands,
+ * anything sent around it (stops, rotations in place) must reset it.
+ * */
+class CommandShaper {
+
+public:
+
+    CommandShaper() : dt_(0.0) {}
+
+    void setControlPeriod(double dt) { dt_ = dt; }
+    double controlPeriod() const { return dt_; }
+
+    void setLinearLimits(double max_acc, double max_jerk) { linear_.setLimits(max_acc, max_jerk); }
+    void setAngularLimits(double max_acc, double max_jerk) { angular_.setLimits(max_acc, max_jerk); }
+
+    // Move the command one control period towards the target, in place
+    void shape(double& linear, double& angular) {
+        linear = linear_.step(linear, dt_);
+        angular = angular_.step(angular, dt_);
+    }
+
+    void reset(double linear = 0.0, double angular = 0.0) {
+        linear_.reset(linear);
+        angular_.reset(angular);
+    }
+
+    bool atRest() const {
+        return std::fabs(linear_.velocity()) < SHAPER_REST_EPSILON &&
+               std::fabs(angular_.velocity()) < SHAPER_REST_EPSILON;
+    }
+
+    double linear() const { return linear_.velocity(); }
+    double angular() const { return angular_.velocity(); }
+
+private:
+
+    double dt_;
+    AxisShaper linear_;
+    AxisShaper angular_;
+};
+
+#endif // LAZY_TRAFFIC_SHAPER_H
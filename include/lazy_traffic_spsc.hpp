@@ -0,0 +1,66 @@
+// Single producer single consumer queue for handing data to the control loop
+
+#ifndef LAZY_TRAFFIC_SPSC_H
+#define LAZY_TRAFFIC_SPSC_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#define SPSC_CACHE_LINE (64)
+
+/***
+ * Bounded lock free ring buffer for exactly one producer thread and one consumer
+ * thread. Neither side ever waits : push fails when the queue is full and pop
+ * when it is empty. Slots are allocated once, items are moved in and out.
+ * */
+template<class T>
+class SpscQueue {
+
+public:
+
+    explicit SpscQueue(size_t capacity) : slots_(capacity + 1), head_(0), tail_(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. On failure item is left as it was.
+    bool push(T&& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = increment(tail);
+        if(next == head_.load(std::memory_order_acquire))
+            return false;
+        slots_[tail] = std::move(item);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if(head == tail_.load(std::memory_order_acquire))
+            return false;
+        item = std::move(slots_[head]);
+        head_.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    // Exact from either side's own point of view, a hint for anyone else
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return slots_.size() - 1; }
+
+private:
+
+    size_t increment(size_t index) const { return index + 1 == slots_.size() ? 0 : index + 1; }
+
+    std::vector<T> slots_;
+    // Written by different threads, kept on separate cache lines
+    alignas(SPSC_CACHE_LINE) std::atomic<size_t> head_;
+    alignas(SPSC_CACHE_LINE) std::atomic<size_t> tail_;
+};
+
+#endif // LAZY_TRAFFIC_SPSC_H
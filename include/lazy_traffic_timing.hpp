@@ -0,0 +1,113 @@
+// Deadline scheduling and timing statistics for the lazy traffic control loop
+
+#ifndef LAZY_TRAFFIC_TIMING_H
+#define LAZY_TRAFFIC_TIMING_H
+
+#include <time.h>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+
+#define NSEC_PER_SEC (1000000000LL)
+
+inline int64_t timespecToNs(const timespec& ts) {
+    return (int64_t)ts.tv_sec*NSEC_PER_SEC + ts.tv_nsec;
+}
+
+inline timespec nsToTimespec(int64_t ns) {
+    timespec ts;
+    ts.tv_sec = ns/NSEC_PER_SEC;
+    ts.tv_nsec = ns%NSEC_PER_SEC;
+    return ts;
+}
+
+inline int64_t monotonicNs(void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespecToNs(ts);
+}
+
+// Running mean and max of one duration (s)
+struct TimingStat {
+
+    uint32_t count = 0;
+    double sum = 0.0;
+    double max = 0.0;
+
+    void add(double seconds) {
+        count++;
+        sum += seconds;
+        max = std::max(max, seconds);
+    }
+
+    double mean() const { return count > 0 ? sum/count : 0.0; }
+
+    void reset() { *this = TimingStat(); }
+};
+
+// Everything the control loop measures over one report window
+struct ControlLoopStats {
+
+    uint32_t ticks = 0;
+    uint32_t deadline_misses = 0;
+    uint32_t skipped_ticks = 0;
+    uint32_t dropped_frames = 0;
+    uint32_t cache_hits = 0;
+    uint32_t cache_misses = 0;
+    TimingStat jitter;
+    TimingStat tick;
+    TimingStat poses;
+    TimingStat preferred;
+    TimingStat obstacles;
+    TimingStat avoidance;
+    TimingStat publish;
+    TimingStat delay;
+
+    void reset() { *this = ControlLoopStats(); }
+};
+
+/***
+ * Wakes a loop up on absolute deadlines of CLOCK_MONOTONIC, so the time a tick
+ * takes and the sleep granularity do not accumulate as drift. A tick that runs
+ * past the next deadline is a miss, and the deadlines that already passed are
+ * skipped instead of being run back to back.
+ * */
+class DeadlineClock {
+
+public:
+
+    explicit DeadlineClock(double period) : period_ns_(std::max<int64_t>(1, (int64_t)(period*NSEC_PER_SEC))), next_ns_(0) {}
+
+    // First deadline is one period from now
+    void start(void) { next_ns_ = monotonicNs(); }
+
+    // Sleeps until the next deadline, returns how late (s) the thread woke up
+    double wait(void) {
+        next_ns_ += period_ns_;
+        timespec deadline = nsToTimespec(next_ns_);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR);
+        return std::max<int64_t>(0, monotonicNs() - next_ns_)/(double)NSEC_PER_SEC;
+    }
+
+    // Call at the end of a tick. Returns the number of deadlines skipped, 0 if it finished in time.
+    uint32_t finish(void) {
+        int64_t overrun = monotonicNs() - next_ns_;
+        if(overrun <= period_ns_)
+            return 0;
+        uint32_t skipped = (uint32_t)((overrun - 1)/period_ns_);
+        next_ns_ += skipped*period_ns_;
+        return skipped;
+    }
+
+    double period(void) const { return period_ns_/(double)NSEC_PER_SEC; }
+
+    // Deadline (monotonic ns) of the current tick
+    int64_t deadline(void) const { return next_ns_; }
+
+private:
+
+    int64_t period_ns_;
+    int64_t next_ns_;
+};
+
+#endif // LAZY_TRAFFIC_TIMING_H
@@ -7,32 +7,44 @@
 #include <cmath>
 #include <algorithm>
 #include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <memory>
 #include <actionlib/server/simple_action_server.h>
 #include <mtg_controller/mtgControllerAction.h>
 
 #include "tf2_geometry_msgs/tf2_geometry_msgs.h"
 #include <tf/tf.h>
 #include <tf2_ros/transform_listener.h>
-#include <tf2_ros/transform_broadcaster.h>
 #include <geometry_msgs/TransformStamped.h>
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Vector3Stamped.h>
 #include <nav_msgs/Path.h>
 #include <nav_msgs/Odometry.h>
 
-#include <kdl/frames.hpp>
 #include <mtg_controller/PurePursuitConfig.h>
 #include <angles/angles.h>
 
+#include "pure_pursuit_tracker.hpp"
+
 class LGControllerAction
 {
 private:
   ros::NodeHandle nh_, nh_private_;
   ros::Timer controller_timer;
   ros::Publisher pub_vel_, pub_acker_;
-  tf2_ros::Buffer tf_buffer_;
-  tf2_ros::TransformListener tf_listener_;
-  tf2_ros::TransformBroadcaster tf_broadcaster_;
+  // A standalone server listens to TF itself, a hosted one uses the host's buffer
+  // and is stepped by the host's timer together with the other hosted servers
+  std::unique_ptr<tf2_ros::Buffer> own_tf_buffer_;
+  std::unique_ptr<tf2_ros::TransformListener> own_tf_listener_;
+  tf2_ros::Buffer* tf_buffer_;
+  bool hosted_;
+  std::atomic<bool> tracking_;
+  // Held for a whole control step, so stopTracking() waits for a step that is already running
+  // and the next goal's receivePath() never overlaps one of the previous goal
+  std::mutex tick_mutex_;
   geometry_msgs::TransformStamped lookahead_;
   std::string map_frame_id_, robot_frame_id_, lookahead_frame_id_, acker_frame_id_;
 
@@ -50,13 +62,23 @@ private:
   // Control variables for Ackermann steering
   // Steering angle is denoted by delta
   double delta_, delta_vel_, acc_, jerk_, delta_max_;
-  std::queue<std::vector<double>> path_;
+  // Waypoints with their times. The path cursor follows the robot for pure pursuit,
+  // time_idx_ follows the schedule and reaches the end once the goal is reached
+  AgentPath path_;
+  size_t time_idx_;
+  PurePursuitTracker tracker_;
   std::queue<geometry_msgs::PoseStamped> goalQueue;
-  unsigned pp_idx_;
+  // goal_reached_ is written by the timer, preempt_requested_ by preemptCB and both are read
+  // by executeCB, all under goal_mutex_. The action server is never called with it held.
   bool goal_reached_;
+  bool preempt_requested_;
+  // Goal the path belongs to, setGoalReached() ignores a step made for an older goal
+  uint64_t goal_generation_;
+  uint64_t path_generation_;
+  std::mutex goal_mutex_;
+  std::condition_variable goal_cv_;
   bool stop_;
   geometry_msgs::Twist cmd_vel_;
-  nav_msgs::Path cartesian_path_;
 
 protected:
 
@@ -69,17 +91,26 @@ public:
   actionlib::SimpleActionServer<mtg_controller::mtgControllerAction> as_; // NodeHandle instance must be created before this line. Otherwise strange error occurs.
 
 
-  LGControllerAction(std::string name) :
+  explicit LGControllerAction(std::string name, tf2_ros::Buffer* shared_tf_buffer = nullptr) :
     as_(nh_, name, boost::bind(&LGControllerAction::executeCB, this, _1), false),action_name_(name),
-    ld_(0.4), v_max_(0.2), v_(v_max_), w_max_(1.0), pos_tol_(0.1), pp_idx_(0),goal_reached_(true), 
-    nh_private_("~"), tf_listener_(tf_buffer_), map_frame_id_("map"), robot_frame_id_("base_link"),
+    ld_(0.4), v_max_(0.2), v_(v_max_), w_max_(1.0), pos_tol_(0.1), time_idx_(0), tracker_(true), goal_reached_(true), preempt_requested_(false), goal_generation_(0), path_generation_(0), 
+    nh_private_("~"), tf_buffer_(shared_tf_buffer), hosted_(shared_tf_buffer != nullptr), tracking_(false),
+    map_frame_id_("map"), robot_frame_id_("base_link"),
     lookahead_frame_id_("lookahead"), controller_period_s(0.2), controller_it(0),
     rotate_to_global_plan(true), stop_(false), goal_threshold(0.2)
   {
+    if(!hosted_) {
+      own_tf_buffer_.reset(new tf2_ros::Buffer());
+      own_tf_listener_.reset(new tf2_ros::TransformListener(*own_tf_buffer_));
+      tf_buffer_ = own_tf_buffer_.get();
+    }
     // Populate messages with static data
     robot_frame_id_ = action_name_ + "/base_link";
     lookahead_.header.frame_id = robot_frame_id_;
     lookahead_.child_frame_id = lookahead_frame_id_;
+    // Advertised once, a hosted server's tick can run on the spinner thread while a goal is accepted
+    pub_vel_ = nh_.advertise<geometry_msgs::Twist>("/mtg_agent_bringup_node/"+action_name_+"/cmd_vel", 1);
+    as_.registerPreemptCallback(boost::bind(&LGControllerAction::preemptCB, this));
     as_.start();
   }
 
@@ -93,74 +124,128 @@ public:
     ROS_INFO("Executing Action");
     controller_it = 0; //Setting controller iterator to 0 every time action is called
     receivePath(goal->path);
-    controller_timer = nh_.createTimer(ros::Duration(controller_period_s),boost::bind(&LGControllerAction::computeVelocities, this, _1));
-    pub_vel_ = nh_.advertise<geometry_msgs::Twist>("/mtg_agent_bringup_node/"+action_name_+"/cmd_vel", 1);
-    while(!goal_reached_) {
-      
-      if (as_.isPreemptRequested() || !ros::ok())
-      {
-        ROS_INFO("%s: Preempted", action_name_.c_str());
-        // set the action state to preempted
-        as_.setPreempted();
-        success = false;
-        controller_timer.stop();
-        break;
-      }
+    startTracking();
+
+    // A cancel that came in before the goal was accepted does not call preemptCB
+    if (as_.isPreemptRequested())
+      preemptCB();
+
+    // Sleep until the timer reports the goal reached or a preempt request wakes us up,
+    // the timeout only makes sure a ROS shutdown is noticed
+    bool preempted = false;
+    {
+      std::unique_lock<std::mutex> lock(goal_mutex_);
+      while(!goal_reached_ && !preempt_requested_ && ros::ok())
+        goal_cv_.wait_for(lock, std::chrono::seconds(1));
+      preempted = !goal_reached_;
     }
 
-    if(goal_reached_)
+    if(preempted)
+    {
+      ROS_INFO("%s: Preempted", action_name_.c_str());
+      // set the action state to preempted
+      as_.setPreempted();
+      success = false;
+      stopTracking();
+    }
+    else
     {
-      controller_timer.stop();
+      stopTracking();
       result_.goal_reached = true;
       ROS_INFO("%s: Succeeded", action_name_.c_str());
       // set the action state to succeeded
       as_.setSucceeded(result_);
     }
+
+    // The goal is done, a preempt request for it must not end the next one
+    std::lock_guard<std::mutex> lock(goal_mutex_);
+    preempt_requested_ = false;
   }
 
   ~LGControllerAction(void)
   {
     
   }
+  // Control step, called by the server's own timer or by the host for all its servers on one timer
+  void tick(const ros::TimerEvent& event)
+  {
+    std::lock_guard<std::mutex> lock(tick_mutex_);
+    if(tracking_)
+      computeVelocities(event);
+  }
+
+  double controllerPeriod() const { return controller_period_s; }
+
+  void startTracking()
+  {
+    tracking_ = true;
+    if(!hosted_)
+      controller_timer = nh_.createTimer(ros::Duration(controller_period_s),boost::bind(&LGControllerAction::tick, this, _1));
+  }
+
+  // Returns once no control step is running, the next goal can then take over the path
+  void stopTracking()
+  {
+    tracking_ = false;
+    controller_timer.stop();
+    std::lock_guard<std::mutex> lock(tick_mutex_);
+  }
+
+  // Wakes executeCB up when the goal is reached, unless generation is not the current goal
+  void setGoalReached(bool reached, uint64_t generation)
+  {
+    {
+      std::lock_guard<std::mutex> lock(goal_mutex_);
+      if(generation != goal_generation_)
+        return;
+      goal_reached_ = reached;
+    }
+    goal_cv_.notify_all();
+  }
+
+  // Called by the action server when the goal is cancelled or replaced
+  // actionlib calls it holding its own lock, so it only takes goal_mutex_ and never calls back into as_
+  void preemptCB()
+  {
+    {
+      std::lock_guard<std::mutex> lock(goal_mutex_);
+      preempt_requested_ = true;
+    }
+    goal_cv_.notify_all();
+  }
+
   void receivePath(nav_msgs::Path new_path)
   {
     ROS_INFO("[mtg Controller-%s] Receiving path!",&action_name_[0]);
+    std::lock_guard<std::mutex> tick_lock(tick_mutex_);
+    {
+      std::lock_guard<std::mutex> lock(goal_mutex_);
+      path_generation_ = ++goal_generation_;
+    }
 
     if(new_path.poses.size()>0)
     {
       // Reset all variables
-      cartesian_path_.poses.clear();
       rotate_to_global_plan = true;
       controller_it = 0;
       stop_ = false;
-      std::queue<std::vector<double>> empty_path_;
-      std::swap( path_, empty_path_ );
+      path_.clear();
+      path_.reserve(new_path.poses.size());
+      time_idx_ = 0;
       std::queue<geometry_msgs::PoseStamped> empty_goalQueue;
       std::swap( goalQueue, empty_goalQueue );
-      pp_idx_ = 0;
       
       for (int idx_ = 0; idx_ < new_path.poses.size(); idx_++){
-        std::vector<double> coordinates;
-        coordinates.push_back(new_path.poses[idx_].pose.position.x);
-        coordinates.push_back(new_path.poses[idx_].pose.position.y);
-        coordinates.push_back(new_path.poses[idx_].pose.position.z); // time
-        if(idx_!= new_path.poses.size()-1)
-        {
-          coordinates.push_back(atan2(new_path.poses[idx_+1].pose.position.y - new_path.poses[idx_].pose.position.y,
-                                        new_path.poses[idx_+1].pose.position.x - new_path.poses[idx_].pose.position.x)); // yaw
-        }
-        else 
-        {
-          coordinates.push_back(0.0); // Dont care
-        }
-        path_.push(coordinates);
+        // Repeated poses are kept, they are where the schedule waits
+        path_.push_back(RVO::Vector2(new_path.poses[idx_].pose.position.x, new_path.poses[idx_].pose.position.y),
+                        new_path.poses[idx_].pose.position.z); // time
         
         geometry_msgs::PoseStamped cartesian_pose;
         cartesian_pose.pose.position.x = new_path.poses[idx_].pose.position.x;
         cartesian_pose.pose.position.y = new_path.poses[idx_].pose.position.y;
         
         // Add points to the goal queue
-        if(idx_!=0 && checkIfPosesEqual(cartesian_pose,cartesian_path_.poses.back()))
+        if(idx_!=0 && checkIfPosesEqual(cartesian_pose,new_path.poses[idx_-1]))
         {
           if(goalQueue.empty()){
             goalQueue.push(cartesian_pose);
@@ -173,28 +258,22 @@ public:
         if(idx_ == new_path.poses.size()-1 && (goalQueue.empty() || !checkIfPosesEqual(cartesian_pose,goalQueue.back()))) {
           goalQueue.push(cartesian_pose);
         }
-
-        // Create cartesian path for pure pursuit
-        if(idx_ == 0 || !checkIfPosesEqual(cartesian_pose,cartesian_path_.poses[cartesian_path_.poses.size()-1]) )
-        {
-          cartesian_path_.poses.push_back(cartesian_pose);
-        }
         
       }
-       goal_reached_ = false;
+       setGoalReached(false, path_generation_);
     }
     else
     {
-      goal_reached_ = true;
+      setGoalReached(true, path_generation_);
       ROS_WARN_STREAM("Received empty path!");
     }
     // When a new path received, the previous one is simply discarded
     // It is up to the planner/motion manager to make sure that the new
     // path is feasible.
-    // Callbacks are non-interruptible, so this will
-    // not interfere with velocity computation callback.
-    ROS_INFO("[mtg Controller-%s] Trajectory size %ld Cartesian path size %ld goal queue %ld",
-                                          &action_name_[0],path_.size(), cartesian_path_.poses.size(), goalQueue.size());
+    // tick_mutex_ keeps it from interleaving with a control step, and
+    // setGoalReached() drops a late step of the previous goal.
+    ROS_INFO("[mtg Controller-%s] Trajectory size %ld length %f goal queue %ld",
+                                          &action_name_[0],path_.totalSize(), path_.length(), goalQueue.size());
 
   }
 
@@ -222,7 +301,7 @@ public:
     geometry_msgs::TransformStamped tf;
     try
     {
-      tf = tf_buffer_.lookupTransform(map_frame_id_, robot_frame_id_, ros::Time(0));
+      tf = tf_buffer_->lookupTransform(map_frame_id_, robot_frame_id_, ros::Time(0));
     }
      catch (tf2::TransformException &ex)
     {
@@ -230,36 +309,35 @@ public:
       // @TODO indraneel should we increment controller_it if we fail to lookup transform?
       return;
     }
-    double yaw = tf::getYaw(tf.transform.rotation);
-    ROS_INFO("[mtg Controller-%s]  Transform x: %f y:%f yaw:%f",&action_name_[0],tf.transform.translation.x,tf.transform.translation.y,yaw);
+    SE2 pose = se2FromTransformMsg(tf.transform);
+    ROS_INFO("[mtg Controller-%s]  Transform x: %f y:%f yaw:%f",&action_name_[0],pose.x,pose.y,pose.yaw());
 
     if(rotate_to_global_plan) {
-        double angle_to_global_plan = calculateGlobalPlanAngle(tf.transform.translation.x,tf.transform.translation.y,yaw);
+        double angle_to_global_plan = calculateGlobalPlanAngle(pose);
         ROS_INFO("[mtg Controller-%s] Shortest angle to goal %f",&action_name_[0],angle_to_global_plan);
         rotate_to_global_plan = rotateToOrientation(angle_to_global_plan,0.1);
     }
     else {
 
       ROS_INFO("Computing Velocity");
-      ppProcessLookahead(tf.transform);
+      ppProcessLookahead(pose);
 
       cycleWaypointsUsingTime();
       controller_it++;
 
-      if(!path_.empty()){
+      if(!scheduleDone()){
 
         // TODO @Charvi linear velocity
         // Distance based check for the final goal
-        if(checkifGoalReached(tf.transform)) {
+        if(checkifGoalReached(pose)) {
           v_ = 0.0;
           stop_ = true;
-          while(!path_.empty())
-            path_.pop();
+          time_idx_ = path_.totalSize();
         }
         // Time based check for the intermediate goals
         else if(goalQueue.size()>1 
-            && compare_float(path_.front()[0],goalQueue.front().pose.position.x) 
-            && compare_float(path_.front()[1],goalQueue.front().pose.position.y)){
+            && compare_float(path_[time_idx_].x(),goalQueue.front().pose.position.x) 
+            && compare_float(path_[time_idx_].y(),goalQueue.front().pose.position.y)){
           v_ = 0.0;
           stop_ = true;
         }
@@ -274,10 +352,9 @@ public:
         cmd_vel_.linear.x = v_;
 
          // Compute the angular velocity.
-        // Lateral error is the y-value of the lookahead point (in base_link frame)
-        double yt = lookahead_.transform.translation.y;
-        double ld_2 = ld_ * ld_;
-        double ang_control = 2*v_ / ld_2 * yt;
+        // Curvature of the arc to the lookahead point (in base_link frame)
+        double ang_control = v_ * PurePursuitTracker::curvature(RVO::Vector2(lookahead_.transform.translation.x,
+                                                                             lookahead_.transform.translation.y));
         cmd_vel_.angular.z = std::min( fabs(ang_control), w_max_ );
         cmd_vel_.angular.z = copysign(cmd_vel_.angular.z, ang_control);
 
@@ -293,22 +370,21 @@ public:
         //Stop moving
         cmd_vel_.linear.x = 0.0;
         cmd_vel_.angular.z = 0.0;
-        goal_reached_ = true;
+        setGoalReached(true, path_generation_);
         ROS_INFO("Stopping!!");
       }
 
       // Publish velocities!
       pub_vel_.publish(cmd_vel_);
 
-      if(path_.empty())
+      if(scheduleDone())
         ROS_INFO("[mtg Controller-%s]: CMD_LIN %f CMD_ANG %f",&action_name_[0],cmd_vel_.linear.x, cmd_vel_.angular.z);
       else
         ROS_INFO("[mtg Controller-%s]: CMD_LIN %f CMD_ANG %f Tracking %f %f at %f",&action_name_[0],cmd_vel_.linear.x, cmd_vel_.angular.z,
-                                                                      path_.front()[0],path_.front()[1],path_.front()[2]);
+                                                                      path_[time_idx_].x(),path_[time_idx_].y(),path_.time(time_idx_));
 
       // Publish the lookahead target transform.
       lookahead_.header.stamp = ros::Time::now();
-      //tf_broadcaster_.sendTransform(lookahead_);
 
     }
 
@@ -319,79 +395,54 @@ public:
   void cycleWaypointsUsingTime() {
 
     double time_elapsed = controller_it*controller_period_s;
-    int it=0;
+    size_t last_idx = time_idx_;
+    if(!scheduleDone())
+      time_idx_ = PurePursuitTracker::advanceByTime(path_, time_idx_, time_elapsed, true);
+    ROS_INFO("[mtg Controller] Popped %ld/%ld velocities with time elapsed %f",time_idx_ - last_idx,path_.totalSize() - time_idx_,time_elapsed);
 
-    while(!path_.empty() && path_.size()!=1 && time_elapsed>path_.front()[2]) {
-      it++;
-      path_.pop();
-    }
-    ROS_INFO("[mtg Controller] Popped %d/%ld velocities with time elapsed %f",it,path_.size(),time_elapsed);
+  }
 
+  bool scheduleDone() const {
+    return time_idx_ >= path_.totalSize();
   }
-  void ppProcessLookahead(geometry_msgs::Transform current_pose) {
 
-    for (; pp_idx_ < cartesian_path_.poses.size(); pp_idx_++)
-    {
-      if (distance(cartesian_path_.poses[pp_idx_].pose.position, current_pose.translation) > ld_)
-      {
+  void ppProcessLookahead(const SE2& current_pose) {
 
-        // Transformed lookahead to base_link frame is lateral error
-        KDL::Frame F_bl_ld = transformToBaseLink(cartesian_path_.poses[pp_idx_].pose, current_pose);
-        lookahead_.transform.translation.x = F_bl_ld.p.x();
-        lookahead_.transform.translation.y = F_bl_ld.p.y();
-        lookahead_.transform.translation.z = F_bl_ld.p.z();
-        F_bl_ld.M.GetQuaternion(lookahead_.transform.rotation.x,
-                                lookahead_.transform.rotation.y,
-                                lookahead_.transform.rotation.z,
-                                lookahead_.transform.rotation.w);
-        
-        // TODO: See how the above conversion can be done more elegantly
-        // using tf2_kdl and tf2_geometry_msgs
-        ROS_INFO("[mtg Controller-%s]: Lookahead X: %f Y: %f",&action_name_[0],lookahead_.transform.translation.x , lookahead_.transform.translation.y);
-        break;
-      }
-    }
+    if (path_.totalSize() == 0)
+      return;
 
-    if (!cartesian_path_.poses.empty() && pp_idx_ >= cartesian_path_.poses.size()) {
+    // Lookahead in the base_link frame is the lateral error
+    PurePursuitTarget target = tracker_.step(path_, current_pose.translation(), ld_);
+    RVO::Vector2 target_bl = PurePursuitTracker::toRobotFrame(target.point, current_pose);
+    lookahead_.transform.translation.x = target_bl.x();
+    lookahead_.transform.translation.y = target_bl.y();
+    lookahead_.transform.translation.z = 0.0;
+    lookahead_.transform.rotation = geometry_msgs::Quaternion();
+    lookahead_.transform.rotation.w = 1.0;
+
+    if (target.end_of_path)
+      ROS_INFO("[mtg Controller-%s]:***** Lookahead X: %f Y: %f",&action_name_[0],lookahead_.transform.translation.x , lookahead_.transform.translation.y);
+    else
+      ROS_INFO("[mtg Controller-%s]: Lookahead X: %f Y: %f",&action_name_[0],lookahead_.transform.translation.x , lookahead_.transform.translation.y);
 
-        // We need to extend the lookahead distance
-        // beyond the goal point.
-      
-        // This is the pose of the goal w.r.t. the base_link frame
-        KDL::Frame F_bl_end = transformToBaseLink(cartesian_path_.poses.back().pose, current_pose);
-
-        // Find the intersection between the circle of radius ld
-        // centered at the robot (origin)
-        // and the line defined by the last path pose
-        double roll, pitch, yaw;
-        F_bl_end.M.GetRPY(roll, pitch, yaw);
-        double k_end = tan(yaw); // Slope of line defined by the last path pose
-        double l_end = F_bl_end.p.y() - k_end * F_bl_end.p.x();
-        double a = 1 + k_end * k_end;
-        double b = 2 * l_end;
-        double c = l_end * l_end - ld_ * ld_;
-        double D = sqrt(b*b - 4*a*c);
-        double x_ld = (-b + copysign(D,v_)) / (2*a);
-        double y_ld = k_end * x_ld + l_end;
-        
-        lookahead_.transform.translation.x = x_ld;
-        lookahead_.transform.translation.y = y_ld;
-        lookahead_.transform.translation.z = F_bl_end.p.z();
-        F_bl_end.M.GetQuaternion(lookahead_.transform.rotation.x,
-                                 lookahead_.transform.rotation.y,
-                                 lookahead_.transform.rotation.z,
-                                 lookahead_.transform.rotation.w);
-        ROS_INFO("[mtg Controller-%s]:***** Lookahead X: %f Y: %f",&action_name_[0],lookahead_.transform.translation.x , lookahead_.transform.translation.y);
-    }
+  }
 
+  // Direction of the segment leaving waypoint idx
+  RVO::Vector2 waypointDirection(size_t idx) const {
+    if(idx + 1 >= path_.totalSize())
+      return RVO::Vector2(1.0, 0.0); // Dont care
+    RVO::Vector2 d = path_[idx+1] - path_[idx];
+    return absSq(d) > 0.0f ? d : RVO::Vector2(1.0, 0.0);
   }
 
-  double calculateGlobalPlanAngle(double x, double y, double yaw) {
+  double calculateGlobalPlanAngle(const SE2& pose) {
 
-      //Calculate the angles between robotpose and global plan point pose
-      double angle_to_goal = path_.front()[3];
+      //Calculate the angle between the robot heading and the global plan direction
+      if(scheduleDone())
+        return 0.0;
+      RVO::Vector2 direction = pose.inverseTransform(pose.translation() + waypointDirection(time_idx_));
       
-      return angles::shortest_angular_distance(yaw, angle_to_goal);
+      return atan2(direction.y(), direction.x());
   }
 
   bool rotateToOrientation(double angle, double accuracy) {
@@ -434,7 +485,7 @@ public:
     try
     {
       geometry_msgs::TransformStamped tfGeom;
-      tfGeom = tf_buffer_.lookupTransform(robot_frame_id_, cmd_global.header.frame_id, cmd_global.header.stamp, ros::Duration(1.0));
+      tfGeom = tf_buffer_->lookupTransform(robot_frame_id_, cmd_global.header.frame_id, cmd_global.header.stamp, ros::Duration(1.0));
       tf2::doTransform(cmd_global,cmd_robot,tfGeom);
     } catch (tf2::TransformException &ex){
       ROS_ERROR("%s",ex.what());
@@ -459,8 +510,9 @@ public:
         theta = copysign(w_max_,theta);
     }
 
-    ROS_INFO("[mtg Controller]: CMD_LIN %f CMD_ANG %f Tracking %f %f at %f",cmd_robot.vector.x,theta,
-                                                                      path_.front()[0],path_.front()[1],path_.front()[2]);
+    if(!scheduleDone())
+      ROS_INFO("[mtg Controller]: CMD_LIN %f CMD_ANG %f Tracking %f %f at %f",cmd_robot.vector.x,theta,
+                                                                      path_[time_idx_].x(),path_[time_idx_].y(),path_.time(time_idx_));
 
     cmd_vel_.linear = cmd_robot.vector;
     cmd_vel_.angular.z = theta;
@@ -471,36 +523,10 @@ public:
   }
 
 
-  KDL::Frame transformToBaseLink(const geometry_msgs::Pose& pose,
-                                            const geometry_msgs::Transform& tf)
-{
-  // Pose in global (map) frame
-  KDL::Frame F_map_pose(KDL::Rotation::Quaternion(pose.orientation.x,
-                                                  pose.orientation.y,
-                                                  pose.orientation.z,
-                                                  pose.orientation.w),
-                        KDL::Vector(pose.position.x,
-                                    pose.position.y,
-                                    pose.position.z));
-
-  // Robot (base_link) in global (map) frame
-  KDL::Frame F_map_tf(KDL::Rotation::Quaternion(tf.rotation.x,
-                                                tf.rotation.y,
-                                                tf.rotation.z,
-                                                tf.rotation.w),
-                      KDL::Vector(tf.translation.x,
-                                  tf.translation.y,
-                                  tf.translation.z));
-
-  // TODO: See how the above conversions can be done more elegantly
-  // using tf2_kdl and tf2_geometry_msgs
-
-  return F_map_tf.Inverse()*F_map_pose;
-}
-
-  bool checkifGoalReached(geometry_msgs::Transform current_pose) {
-
-    double distance_to_goal = distance(current_pose.translation, goalQueue.back().pose.position);
+  bool checkifGoalReached(const SE2& current_pose) {
+
+    double distance_to_goal = abs(current_pose.translation() - RVO::Vector2(goalQueue.back().pose.position.x,
+                                                                            goalQueue.back().pose.position.y));
     if(distance_to_goal <= goal_threshold)
     {
       ROS_WARN("Goal reached!");
@@ -509,14 +535,6 @@ public:
     else 
       return false; 
   }
-
-
-  //! Helper founction for computing eucledian distances in the x-y plane.
-  template<typename T1, typename T2>
-  double distance(T1 pt1, T2 pt2)
-  {
-    return sqrt(pow(pt1.x - pt2.x,2) + pow(pt1.y - pt2.y,2) + pow(pt1.z - pt2.z,2));
-  }
 };
 
 
@@ -0,0 +1,83 @@
+// Pure pursuit path tracking shared by the lazy traffic controller and the action servers
+
+#ifndef PURE_PURSUIT_TRACKER_H
+#define PURE_PURSUIT_TRACKER_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "Vector2.h"
+#include "lazy_traffic_path.hpp"
+#include "se2.hpp"
+
+// Result of one tracking step, positions are in the map frame
+struct PurePursuitTarget {
+    RVO::Vector2 point; // Lookahead point
+    double progress; // Arc length of the robot's projection onto the path
+    double s; // Arc length of the lookahead point
+    bool end_of_path; // Lookahead reaches the last waypoint
+};
+
+/***
+ * ROS free pure pursuit on an AgentPath. A step projects the robot onto the
+ * path, places the lookahead point a lookahead distance further along it and
+ * moves the path cursor with the robot. Nothing is allocated per step and the
+ * cost does not depend on the path length.
+ * Past the last waypoint the lookahead either stays on it or, for controllers
+ * that have to keep pointing along the path while they stop, continues on the
+ * line through the last segment.
+ * */
+class PurePursuitTracker {
+
+public:
+
+    explicit PurePursuitTracker(bool extend_past_end = false) : extend_past_end_(extend_past_end) {}
+
+    PurePursuitTarget step(AgentPath& path, const RVO::Vector2& position, double lookahead) const {
+        return lookaheadFrom(path, path.track(position), lookahead);
+    }
+
+    // Second half of step, for callers that need the progress to pick the lookahead
+    PurePursuitTarget lookaheadFrom(AgentPath& path, double progress, double lookahead) const {
+        PurePursuitTarget target;
+        target.progress = progress;
+        target.s = target.progress + lookahead;
+        target.end_of_path = target.s >= path.length();
+        target.point = path.pointAt(target.s);
+        if(target.end_of_path) {
+            path.advanceTo(path.totalSize() - 1);
+            if(extend_past_end_ && path.totalSize() >= 2) {
+                RVO::Vector2 last = path.back() - path[path.totalSize() - 2];
+                if(absSq(last) > 0.0f)
+                    target.point = path.back() + norm(last)*(float)(target.s - path.length());
+            }
+        }
+        return target;
+    }
+
+    // Point in the frame of a robot at pose, x forward and y left
+    static RVO::Vector2 toRobotFrame(const RVO::Vector2& point, const SE2& pose) {
+        return pose.inverseTransform(point);
+    }
+
+    // Curvature of the arc through the robot that ends at target (robot frame)
+    static double curvature(const RVO::Vector2& target) {
+        float dist_sq = absSq(target);
+        return dist_sq > 0.0f ? 2.0*target.y()/dist_sq : 0.0;
+    }
+
+    // Index of the first waypoint from index on whose time is not before t. With keep_last
+    // the last waypoint is never passed, so the result stays a valid index.
+    static size_t advanceByTime(const AgentPath& path, size_t index, double t, bool keep_last) {
+        size_t end = keep_last && path.totalSize() > 0 ? path.totalSize() - 1 : path.totalSize();
+        while(index < end && t > path.time(index))
+            index++;
+        return index;
+    }
+
+private:
+
+    bool extend_past_end_;
+};
+
+#endif // PURE_PURSUIT_TRACKER_H
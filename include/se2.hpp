@@ -0,0 +1,104 @@
+// Planar rigid transforms for path tracking and heading computations
+
+#ifndef SE2_H
+#define SE2_H
+
+#include <cmath>
+#include <algorithm>
+
+#include "Vector2.h"
+
+/***
+ * Pose / transform in the plane, stored as translation plus the cosine and sine
+ * of the heading so composing, inverting and applying it needs no trig.
+ * Angles only appear when converting from and to ROS messages, which is done
+ * through the templates below so this header does not depend on ROS.
+ * The rotation is assumed to be normalised, c*c + s*s = 1.
+ * */
+struct SE2 {
+
+    double x;
+    double y;
+    double c;
+    double s;
+
+    constexpr SE2() : x(0.0), y(0.0), c(1.0), s(0.0) {}
+    constexpr SE2(double x, double y, double c, double s) : x(x), y(y), c(c), s(s) {}
+
+    static SE2 fromYaw(double x, double y, double yaw) {
+        return SE2(x, y, std::cos(yaw), std::sin(yaw));
+    }
+
+    // Pose at (x, y) heading along (dx, dy), identity heading for a zero direction
+    static SE2 fromDirection(double x, double y, double dx, double dy) {
+        double n = std::sqrt(dx*dx + dy*dy);
+        return n > 0.0 ? SE2(x, y, dx/n, dy/n) : SE2(x, y, 1.0, 0.0);
+    }
+
+    // Heading of a rotation about z given as quaternion (qz, qw). cos and sin of
+    // the full angle follow from the half angle ones without calling atan2.
+    static SE2 fromQuaternion(double x, double y, double qz, double qw) {
+        double n = qz*qz + qw*qw;
+        if(n <= 0.0)
+            return SE2(x, y, 1.0, 0.0);
+        return SE2(x, y, (qw*qw - qz*qz)/n, 2.0*qw*qz/n);
+    }
+
+    // Quaternion (qz, qw) of the heading, with qw >= 0
+    void toQuaternion(double& qz, double& qw) const {
+        qw = std::sqrt(std::max(0.0, 0.5*(1.0 + c)));
+        qz = std::copysign(std::sqrt(std::max(0.0, 0.5*(1.0 - c))), s);
+    }
+
+    double yaw() const { return std::atan2(s, c); }
+
+    // this * other, i.e. other expressed in the frame this is expressed in
+    constexpr SE2 operator*(const SE2& o) const {
+        return SE2(x + c*o.x - s*o.y, y + s*o.x + c*o.y, c*o.c - s*o.s, s*o.c + c*o.s);
+    }
+
+    constexpr SE2 inverse() const {
+        return SE2(-c*x - s*y, s*x - c*y, c, -s);
+    }
+
+    constexpr double transformX(double px, double py) const { return x + c*px - s*py; }
+    constexpr double transformY(double px, double py) const { return y + s*px + c*py; }
+
+    // Point in this frame to the parent frame
+    RVO::Vector2 transform(const RVO::Vector2& p) const {
+        return RVO::Vector2(transformX(p.x(), p.y()), transformY(p.x(), p.y()));
+    }
+    // Point in the parent frame to this frame, same as inverse().transform(p)
+    RVO::Vector2 inverseTransform(const RVO::Vector2& p) const {
+        double dx = p.x() - x, dy = p.y() - y;
+        return RVO::Vector2(c*dx + s*dy, -s*dx + c*dy);
+    }
+
+    RVO::Vector2 translation() const { return RVO::Vector2(x, y); }
+    RVO::Vector2 heading() const { return RVO::Vector2(c, s); }
+};
+
+// geometry_msgs::Transform to SE2, anything out of the plane is dropped
+template<class TransformMsg>
+inline SE2 se2FromTransformMsg(const TransformMsg& tf) {
+    return SE2::fromQuaternion(tf.translation.x, tf.translation.y, tf.rotation.z, tf.rotation.w);
+}
+
+// geometry_msgs::Pose to SE2
+template<class PoseMsg>
+inline SE2 se2FromPoseMsg(const PoseMsg& pose) {
+    return SE2::fromQuaternion(pose.position.x, pose.position.y, pose.orientation.z, pose.orientation.w);
+}
+
+// Heading of pose into a geometry_msgs::Quaternion
+template<class QuaternionMsg>
+inline void se2ToQuaternionMsg(const SE2& pose, QuaternionMsg& q) {
+    double qz, qw;
+    pose.toQuaternion(qz, qw);
+    q.x = 0.0;
+    q.y = 0.0;
+    q.z = qz;
+    q.w = qw;
+}
+
+#endif // SE2_H
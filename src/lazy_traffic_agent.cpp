@@ -11,11 +11,12 @@
 #define EPSILON 10e-3
 
 void Agent::stopAgent(void) {
-  // TODO Check if velocity is non zero
-  geometry_msgs::Twist vel;
-  vel.linear.x = 0.0;
-  vel.angular.z = 0.0;
-  pub_vel_.publish(vel);
+  // The zero command goes out with the next computed command, so in the pipelined
+  // tick it is published after the commands computed before the stop
+  stop_pending_ = true;
+  preferred_velocity_ = RVO::Vector2(0.0, 0.0);
+  rvo_velocity_ = RVO::Vector2(0.0, 0.0);
+  shaper_.reset();
   at_rest = true;
 }
 
@@ -24,22 +25,52 @@ void Agent::stopAgent(void) {
 
 void Agent::clearPath(void){
   
-  std::queue<geometry_msgs::PoseStamped>().swap(current_path_);
+  current_path_.clear();
 
 }
 void Agent::sendVelocity(RVO::Vector2 velo) {
 
-  // Check if velocity is non zero
+  AgentCommand command;
+  if (computeCommand(velo, command))
+    pub_vel_.publish(command.twist);
+}
+
+bool Agent::computeCommand(RVO::Vector2 velo, AgentCommand& command) {
+
+  command.publisher = pub_vel_;
+  geometry_msgs::Twist& vel = command.twist;
+
+  if (stop_pending_) {
+    stop_pending_ = false;
+    vel = geometry_msgs::Twist();
+    command.stop = true;
+    return true;
+  }
+
+  // Turning in place for a coverage search, sent at the command rate like any other command
+  if (agent_state_ == ROTATION) {
+    vel.linear.x = 0.0;
+    vel.angular.z = SEARCH_ANGULAR_VELOCITY;
+    shaper_.reset(vel.linear.x, vel.angular.z);
+    at_rest = true;
+    ROS_DEBUG("Rotating in place");
+    return true;
+  }
+
+  // Zero velocity is only sent while ramping down from the last command
   if (AreSame(velo.x(), 0.0) && AreSame(velo.y(), 0.0)) {
-    return;
+    if (shaper_.atRest())
+      return false;
+    double linear = 0.0, angular = 0.0;
+    shaper_.shape(linear, angular);
+    vel.linear.x = linear;
+    vel.angular.z = angular;
+    at_rest = AreSame(vel.linear.x, 0.0);
+    return true;
   }
   // Update status because sending non zero velocity
   status.data = status.BUSY;
 
-  // TODO Put limits on acceleration
-
-  geometry_msgs::Twist vel;
-
   // Get heading diff with a dot product
   RVO::Vector2 heading = getCurrentHeading();
   RVO::Vector2 velo_norm = norm(velo);
@@ -53,30 +84,28 @@ void Agent::sendVelocity(RVO::Vector2 velo) {
   vel.angular.z = acos(angular_z);
 
   // Map linear velocity based on error in angular velocity
-  vel.linear.x = 0.0 + v_max_ * (1.0 - fabs(vel.angular.z) / CONTROL_ANGLE_THRESHOLD);
+  vel.linear.x = 0.0 + speed_limit_ * (1.0 - fabs(vel.angular.z) / CONTROL_ANGLE_THRESHOLD);
   vel.linear.x = fabs(vel.angular.z)>CONTROL_ANGLE_THRESHOLD ? 0.0 : vel.linear.x;
   vel.linear.x = at_rest && fabs(vel.angular.z)>CONTROL_ANGLE_THRESHOLD_INIT ? 0.0 : vel.linear.x;
-  at_rest = AreSame(vel.linear.x, 0.0) ? true : false;
 
   vel.angular.z = std::min(fabs(vel.angular.z), w_max_);
   vel.angular.z = copysign(vel.angular.z, cross_product);
+
+  // Limit acceleration and jerk, at_rest follows what is actually sent
+  shaper_.shape(vel.linear.x, vel.angular.z);
+  at_rest = AreSame(vel.linear.x, 0.0) ? true : false;
   
   //vel.linear.x = v_max_;
-  pub_vel_.publish(vel);
-
   //ROS_INFO("[LT_CONTROLLER-%s]: Sent Velo LIN: %f ANG: %f", &name_[0], vel.linear.x, vel.angular.z);
+  return true;
+}
+void Agent::startSearchState(int state) {
+
+  agent_state_ = state;
+  search_state_start_ = ros::Time::now();
+  search_heading_ = current_pose_;
+  search_yaw_ = 0.0;
 }
-void Agent::rotateInPlace() {
-  
-    geometry_msgs::Twist vel;
-    vel.linear.x = 0.0;
-    vel.angular.z = SEARCH_ANGULAR_VELOCITY;
-    // vel.angular.x = 0.0;
-    // vel.angular.y = 0.0;
-    vel.linear.y = 0.0;
-    pub_vel_.publish(vel);
-    ROS_DEBUG("Rotating in place");
-  }
 
 void Agent::updatePreferredVelocity()
 {
@@ -97,30 +126,37 @@ void Agent::updatePreferredVelocity()
       {
         case TRACKING:
           ROS_WARN("[LT_CONTROLLER-%s] Coverage goal received, entering turn in place! ", &name_[0]);
-          agent_state_ = ROTATION;
-          rot_count_ = 0;
-          pause_count_ = 0;
+          search_segment_ = 0;
+          startSearchState(ROTATION);
         case ROTATION:
-          rotateInPlace();
-          rot_count_++;
-          ROS_WARN("[LT_CONTROLLER-%s] Search task in rotation state %d ", &name_[0],rot_count_);
-          if(rot_count_ == SEARCH_ROTATION_TIMESTEPS*SEARCH_NUM_ROTATIONS){
+        {
+          // Progress is the yaw measured from TF, the command tick rate does not change how far it turns
+          double turned = std::atan2(search_heading_.c*current_pose_.s - search_heading_.s*current_pose_.c,
+                                     search_heading_.c*current_pose_.c + search_heading_.s*current_pose_.s);
+          search_yaw_ += std::copysign(1.0, SEARCH_ANGULAR_VELOCITY)*turned;
+          search_heading_ = current_pose_;
+          double elapsed = (ros::Time::now() - search_state_start_).toSec();
+          ROS_WARN("[LT_CONTROLLER-%s] Search task in rotation %d, turned %f rad ", &name_[0], search_segment_, search_yaw_);
+          if(search_yaw_ < SEARCH_SEGMENT_ANGLE && elapsed < SEARCH_SEGMENT_TIMEOUT)
+            break;
+          if(search_yaw_ < SEARCH_SEGMENT_ANGLE)
+            ROS_WARN("[LT_CONTROLLER-%s] Search rotation timed out after %f rad", &name_[0], search_yaw_);
+          search_segment_++;
+          if(search_segment_ == SEARCH_NUM_ROTATIONS){
             agent_state_ = ROTATION_COMPLETED;
           }
-          else if(rot_count_%SEARCH_ROTATION_TIMESTEPS==0)
+          else
           {
-            agent_state_ = SEARCHING;
+            startSearchState(SEARCHING);
+            stopAgent();
           }
           break;
+        }
         case SEARCHING:
           stopAgent();
-          pause_count_++;
           ROS_WARN("[LT_CONTROLLER-%s] ________________________________", &name_[0]);
-          if(pause_count_==SEARCH_PAUSE_TIMESTEPS )
-          {
-            agent_state_ = ROTATION;
-            pause_count_ = 0;
-          }
+          if((ros::Time::now() - search_state_start_).toSec() >= SEARCH_PAUSE_TIME)
+            startSearchState(ROTATION);
           break;
         default:
           ROS_ERROR("Invalid state %d", agent_state_);
@@ -142,93 +178,81 @@ void Agent::updatePreferredVelocity()
   }
   else
   {
-    ppProcessLookahead(current_pose_.transform);
+    ppProcessLookahead(current_pose_);
+
+    // Follow the planner's timing if the path has one
+    speed_limit_ = current_path_.scheduled() ? computeScheduledSpeed(ros::Time::now()) : v_max_;
 
     // Calculate preferred velocity vector from current pose to lookahead point
-    preferred_velocity_ = RVO::Vector2(lookahead_.transform.translation.x - current_pose_.transform.translation.x,
-                                       lookahead_.transform.translation.y - current_pose_.transform.translation.y);
+    preferred_velocity_ = lookahead_ - current_pose_.translation();
     preferred_velocity_ = norm(preferred_velocity_);
-    preferred_velocity_ *= v_max_;
+    preferred_velocity_ *= speed_limit_;
     ROS_INFO("[LT_CONTROLLER-%s]: Preferred Velo X: %f Y: %f", &name_[0], preferred_velocity_.x(), preferred_velocity_.y());
     publishPreferredVelocityMarker();
   }
 
 }
 
-//! Helper founction for computing eucledian distances in the x-y plane.
-template <typename T1, typename T2>
-double distance(T1 pt1, T2 pt2)
-{
-  return sqrt(pow(pt1.x - pt2.x, 2) + pow(pt1.y - pt2.y, 2));
-}
-
-void Agent::ppProcessLookahead(geometry_msgs::Transform current_pose)
+void Agent::ppProcessLookahead(const SE2& current_pose)
 {
 
-  // for (; pp_idx_ < cartesian_path_.poses.size(); pp_idx_++)
-  int pp_idx = 0;
-  // Find closest point on path and pop all the previous points
-  std::queue<geometry_msgs::PoseStamped> local_path_ = current_path_;
-  double min_dist = INFINITY;
-  int min_pp_idx = 0;
-  while (!local_path_.empty())
-  {
-    double dist_to_front_point = distance(local_path_.front().pose.position, current_pose.translation); 
-    if (dist_to_front_point < min_dist)
-    {
-      min_dist = dist_to_front_point;
-      min_pp_idx = pp_idx;
-    }
-    local_path_.pop();
-    pp_idx++;
-  }
-
-  // pop points till min pp_idx
-  for (int idx = 0; idx < min_pp_idx; idx++)
+  if (current_path_.empty())
   {
-    current_path_.pop();
+    ROS_ERROR("[LT_CONTROLLER-%s]: No path to follow. Stopping agent.", &name_[0]);
+    return;
   }
 
-  while (current_path_.size() > 1)
-  {
-    double dist_to_path = distance(current_path_.front().pose.position, current_pose.translation);
-    if (dist_to_path > ld_)
-    {
-      // Save this as the lookahead point
-      lookahead_.transform.translation.x = current_path_.front().pose.position.x;
-      lookahead_.transform.translation.y = current_path_.front().pose.position.y;
-
-      // TODO: See how the above conversion can be done more elegantly
-      // using tf2_kdl and tf2_geometry_msgs
-      ROS_INFO("[LT_CONTROLLER-%s]: Lookahead X: %f Y: %f", &name_[0], lookahead_.transform.translation.x, lookahead_.transform.translation.y);
-      return;
-    }
-    else
-    {
-      current_path_.pop();
-    }
-  }
+  // Project the robot onto the path and look ld_ further along it
+  RVO::Vector2 position = current_pose.translation();
+  double progress = current_path_.track(position);
+  ld_ = computeLookaheadDistance(progress);
+  PurePursuitTarget target = tracker_.lookaheadFrom(current_path_, progress, ld_);
+  lookahead_ = target.point;
 
-  if (!current_path_.empty())
+  if (target.end_of_path)
   {
-
     // Lookahead point is the last point in the path
-    lookahead_.transform.translation.x = current_path_.front().pose.position.x;
-    lookahead_.transform.translation.y = current_path_.front().pose.position.y;
-
-    ROS_INFO("[LT_CONTROLLER-%s]:***** Lookahead X: %f Y: %f", &name_[0], lookahead_.transform.translation.x, lookahead_.transform.translation.y);
+    ROS_INFO("[LT_CONTROLLER-%s]:***** Lookahead X: %f Y: %f", &name_[0], lookahead_.x(), lookahead_.y());
   }
   else
   {
-    ROS_ERROR("[LT_CONTROLLER-%s]: No path to follow. Stopping agent.", &name_[0]);
+    ROS_INFO("[LT_CONTROLLER-%s]: Lookahead X: %f Y: %f", &name_[0], lookahead_.x(), lookahead_.y());
   }
 }
+double Agent::computeScheduledSpeed(const ros::Time& now)
+{
+  double t = (now - schedule_start_).toSec();
+  double progress = current_path_.progress();
+
+  // Planned speed, corrected by how far (m) the agent is behind the plan
+  double distance_lag = current_path_.scheduledArcLength(t) - progress;
+  double speed = current_path_.scheduledSpeed(t) + SCHEDULE_LAG_GAIN * distance_lag;
+
+  schedule_lag_ = t - current_path_.scheduledTime(progress);
+  std_msgs::Float64 lag;
+  lag.data = schedule_lag_;
+  pub_schedule_lag_.publish(lag);
+
+  return boost::algorithm::clamp(speed, SCHEDULE_MIN_SPEED, v_max_);
+}
+
+double Agent::computeLookaheadDistance(double progress)
+{
+  // Look further ahead when moving fast, less when the path turns within the lookahead
+  double ld = ld_min_ + ld_speed_gain_ * abs(current_velocity_);
+  ld = std::min(ld, ld_max_);
+  double turning = current_path_.turning(progress, progress + ld);
+  ld = ld / (1.0 + ld_turn_gain_ * turning);
+  return boost::algorithm::clamp(ld, ld_min_, ld_max_);
+}
+
 // If goal reached, ask robot to spin around once 
 
 bool Agent::checkifGoalReached()
 {
 
-  double distance_to_goal = distance(current_pose_.transform.translation, current_path_.front().pose.position);
+  RVO::Vector2 position = current_pose_.translation();
+  double distance_to_goal = euclidean_dist(position, current_path_.front());
   if (distance_to_goal <= goal_threshold_)
   {
     return true;
@@ -240,23 +264,21 @@ bool Agent::checkifGoalReached()
 RVO::Vector2 Agent::getCurrentHeading()
 {
 
-  tf2::Quaternion quat(current_pose_.transform.rotation.x, current_pose_.transform.rotation.y, current_pose_.transform.rotation.z, current_pose_.transform.rotation.w);
-
-  // Convert to RPY
-  double roll, pitch, yaw;
-  tf2::Matrix3x3(quat).getRPY(roll, pitch, yaw);
-
-  // Convert to unit vector
-  RVO::Vector2 heading(cos(yaw), sin(yaw));
+  // Unit vector of the heading, straight from the pose
+  RVO::Vector2 heading = current_pose_.heading();
   myheading_ = heading;
   return heading;
 }
 
-void Agent::invokeRVO(std::unordered_map<std::string, Agent> agent_map, const nav_msgs::OccupancyGrid& ocm) {
+bool Agent::requiresAvoidance(void) const {
   // Dont invoke RVO if the preferred velocity is zero
   // or if there is no path to follow
-  if ((AreSame(preferred_velocity_.x(), 0.0) && AreSame(preferred_velocity_.y(), 0.0)) ||
-       current_path_.empty()) {
+  return !((AreSame(preferred_velocity_.x(), 0.0) && AreSame(preferred_velocity_.y(), 0.0)) ||
+            current_path_.empty());
+}
+
+void Agent::invokeRVO(const std::unordered_map<std::string, Agent>& agent_map, const InflationLayer& inflation_layer) {
+  if (!requiresAvoidance()) {
     rvo_velocity_ = RVO::Vector2(0.0, 0.0);
     return;
   }
@@ -264,9 +286,13 @@ void Agent::invokeRVO(std::unordered_map<std::string, Agent> agent_map, const na
   bool isHoming = homing_;
   // Calculate dynamic and static neighbours
   isCollision = computeNearestNeighbors(agent_map, isHoming);
-  computeStaticObstacles(ocm);
+  const InflationLayer* static_layer = nullptr;
+  if(USE_INFLATION_LAYER == 1 && USE_STATIC_OBSTACLE_AVOIDANCE == 1)
+    static_layer = &inflation_layer;
+  else
+    computeStaticObstacles();
 
-  RVO::Vector2 current_position(current_pose_.transform.translation.x, current_pose_.transform.translation.y);
+  RVO::Vector2 current_position = current_pose_.translation();
   // Create new self structure for RVO
   rvo_agent_obstacle_info_s my_info{name_, current_velocity_, preferred_velocity_, current_position, v_max_};
   
@@ -274,9 +300,9 @@ void Agent::invokeRVO(std::unordered_map<std::string, Agent> agent_map, const na
 
   // Calculate new velocity
   if(!isCollision) {
-    rvo_velocity_ = rvoComputeNewVelocity(my_info, neighbors_list_, isHoming);
+    rvo_velocity_ = rvoComputeNewVelocity(my_info, neighbors_list_, isHoming, static_layer);
   } else {
-    rvo_velocity_ = rvoComputeNewVelocity(my_info, neighbors_list_, isHoming);
+    rvo_velocity_ = rvoComputeNewVelocity(my_info, neighbors_list_, isHoming, static_layer);
     rvo_velocity_ = flockControlVelocity_weighted(my_info, repulsion_list_, rvo_velocity_);
   }
 
@@ -285,104 +311,72 @@ void Agent::invokeRVO(std::unordered_map<std::string, Agent> agent_map, const na
   ROS_INFO("[LT_CONTROLLER-%s]: RVO Velo X: %f Y: %f", &name_[0], rvo_velocity_.x(), rvo_velocity_.y());
 }
 
-void Agent::staticObstacleBfs(const RVO::Vector2& start, const std::vector<int8_t>& map_data, 
-                                const int& map_width, const int& map_height, const float& map_resolution,
-                                const geometry_msgs::Point& map_origin) {
-  
-  // Local variables
-  std::queue<std::pair<int,int>> queue;
-  std::set<int> visited;
-  int grids_explored=0;
-  int obstacle_count = 0;
+AgentRisk Agent::assessRisk(std::vector<std::string>* closing) const {
+
+  AgentRisk risk;
+  RVO::Vector2 position = current_pose_.translation();
+  // Time to collision at the velocity just planned, against the velocity each neighbor is expected to keep
+  for (const auto &neigh : neighbors_list_) {
+    float radius = RVO_RADIUS_MULT_FACTOR*RVO_AGENT_RADIUS;
+    float ttc = neigh.has_prediction ? rvoPredictedTimeToCollision(position, rvo_velocity_, neigh, radius)
+                                     : rvoTimeToCollision(position, rvo_velocity_ - neigh.currrent_velocity,
+                                                          neigh.current_position, radius, false);
+    risk.ttc = std::min(risk.ttc, (double)ttc);
+    if (closing && ttc < SCHED_TTC_SAFE)
+      closing->push_back(neigh.agent_name);
+  }
+  // Neighbors inside the repulsion radius are as risky as it gets
+  if (!repulsion_list_.empty())
+    risk.ttc = 0.0;
+  if (closing) {
+    for (const auto &neigh : repulsion_list_)
+      closing->push_back(neigh.agent_name);
+  }
+  risk.neighbors = neighbors_list_.size();
+  if (!current_path_.empty())
+    risk.tracking_error = abs(current_path_.pointAt(current_path_.progress()) - position);
+  return risk;
+}
 
-  //Convert to pixel and add it to queue
-  std::pair<int,int> start_ind = std::make_pair((int)((start.x()-map_origin.x)/map_resolution),
-                                                (int)((start.y()-map_origin.y)/map_resolution));
-  queue.push(start_ind);
-  
-  while(!queue.empty()) {
-    std::pair<int,int> current = queue.front();
-    queue.pop();
+bool Agent::lookupStaticObstacleCache(uint64_t map_version, int cell_x, int cell_y) {
 
-    //if already visited, continue to next iteration
-    if(visited.find((current.first + current.second*map_width)) != visited.end()) 
-      continue;
-    // insert into visited
-    else
-      visited.insert(current.first + current.second*map_width);
-
-    // Check if reached end of BFS radius
-    RVO::Vector2 start_position(start.x(), start.y());
-    //convert to world coordinates
-    RVO::Vector2 current_position(map_origin.x + map_resolution*(float)(current.first), 
-                                  map_origin.y + map_resolution*(float)(current.second));
-
-    float dist = euclidean_dist(current_position, start_position);
-    if(dist > MAX_STATIC_OBS_DIST) {
-      //ROS_INFO("Outside radius. Exiting obstacle search");
-      break;
-    }
+  return obstacle_cache_.lookup(map_version, cell_x, cell_y);
+}
 
-    // Check if obstacle
-    if (map_data[current.first + current.second*map_width] > 0) {
-      
-      // Add to obstacle list
-      //ROS_INFO("adding static obstacle at %f, %f", current_position.x(), current_position.y());
-      obstacle_count++;
-      rvo_agent_obstacle_info_s obs;
-      obs.agent_name = "obstacle"+std::to_string(obstacle_count);
-      RVO::Vector2 obs_pos(current_position.x(), current_position.y());
-      obs.current_position = obs_pos;
-      obs.currrent_velocity = RVO::Vector2(0.0,0.0);
-      neighbors_list_.push_back(obs);
-      // repulsion_list_.push_back(obs); // TODO : Will the other agents at home be considered obstacles?
-    }
+void Agent::setStaticObstacles(const FleetObstacleIndex& fleet_obstacles, int slot,
+                               uint64_t map_version, int cell_x, int cell_y) {
 
-    //expand node
-    for(const auto& dir : dir_) {
-      std::pair<int,int> neighbour_ind = std::make_pair(current.first + dir[0], current.second + dir[1]);
-      //Boundary checks
-      if (neighbour_ind.first >= 0 && neighbour_ind.first < map_height && 
-          neighbour_ind.second >= 0 && neighbour_ind.second < map_width ) {
-            queue.push(neighbour_ind);
-      }
-    }
-  }
+  static_obstacles_.clear();
+  for(uint32_t index : fleet_obstacles.agentObstacles(slot))
+    static_obstacles_.push_back(fleet_obstacles.obstacle(index));
+
+  obstacle_cache_.store(map_version, cell_x, cell_y);
 }
 
-void Agent::computeStaticObstacles(const nav_msgs::OccupancyGrid& new_map) {
+void Agent::computeStaticObstacles(void) {
 
   if(USE_STATIC_OBSTACLE_AVOIDANCE != 1)
     return;
 
-  // Get the map resolution
-  float map_resolution = new_map.info.resolution;
-
-  // Get the map origin
-  geometry_msgs::Point map_origin;
-  map_origin.x = new_map.info.origin.position.x;
-  map_origin.y = new_map.info.origin.position.y;
-
-  // Get the map dimensions
-  int map_width = new_map.info.width;
-  int map_height = new_map.info.height;
-
-  // Get the map data
-  std::vector<int8_t> map_data;
-  map_data.clear();
-  map_data.resize(map_width*map_height);
-  map_data = new_map.data;
-  RVO::Vector2 current_position(current_pose_.transform.translation.x, current_pose_.transform.translation.y);
-  //call bfs on agent to detect static obstacles
-  staticObstacleBfs(current_position, map_data, map_width, map_height, map_resolution, map_origin);
-
+  // Occupied cells within MAX_STATIC_OBS_DIST, extracted for the whole fleet by the controller
+  int obstacle_count = 0;
+  for(const auto& obs_pos : static_obstacles_) {
+    // Add to obstacle list
+    obstacle_count++;
+    rvo_agent_obstacle_info_s obs;
+    obs.agent_name = "obstacle"+std::to_string(obstacle_count);
+    obs.current_position = obs_pos;
+    obs.currrent_velocity = RVO::Vector2(0.0,0.0);
+    neighbors_list_.push_back(obs);
+    // repulsion_list_.push_back(obs); // TODO : Will the other agents at home be considered obstacles?
+  }
 }
-bool Agent::computeNearestNeighbors(std::unordered_map<std::string, Agent> agent_map, bool isHoming)
+bool Agent::computeNearestNeighbors(const std::unordered_map<std::string, Agent>& agent_map, bool isHoming)
 {
   bool result = false;
   priority_queue<AgentDistPair, vector<AgentDistPair>, greater<AgentDistPair>> all_neighbors;
   std::vector<std::string> repulsion_neighbours;
-  RVO::Vector2 my_pose(current_pose_.transform.translation.x, current_pose_.transform.translation.y);
+  RVO::Vector2 my_pose = current_pose_.translation();
   neighbors_list_.clear();
   repulsion_list_.clear();
 
@@ -393,14 +387,14 @@ bool Agent::computeNearestNeighbors(std::unordered_map<std::string, Agent> agent
     if(agent.first == name_)
       continue;
 
-    RVO::Vector2 neigh_agent_pos(agent.second.current_pose_.transform.translation.x, agent.second.current_pose_.transform.translation.y);
+    RVO::Vector2 neigh_agent_pos = agent.second.current_pose_.translation();
     string neighbour_agent_name = agent.first;
     float euc_distance = euclidean_dist(neigh_agent_pos, my_pose);
     if(euc_distance < REPULSION_RADIUS) {
       if (isHoming)
       {
-        if (!(AreSame(agent_map[neighbour_agent_name].preferred_velocity_.x(), 0.0) &&
-              AreSame(agent_map[neighbour_agent_name].preferred_velocity_.y(), 0.0)))
+        if (!(AreSame(agent_map.at(neighbour_agent_name).preferred_velocity_.x(), 0.0) &&
+              AreSame(agent_map.at(neighbour_agent_name).preferred_velocity_.y(), 0.0)))
         {
           result = true;
           repulsion_neighbours.push_back(neighbour_agent_name);
@@ -426,51 +420,67 @@ bool Agent::computeNearestNeighbors(std::unordered_map<std::string, Agent> agent
     // Create and add the nearest neighbor to the list of neighbors
     rvo_agent_obstacle_info_s neigh;
     neigh.agent_name = agent_dist_pair.first;
-    RVO::Vector2 neigh_agent_pos(agent_map[neigh.agent_name].current_pose_.transform.translation.x, 
-                                  agent_map[neigh.agent_name].current_pose_.transform.translation.y);
+    RVO::Vector2 neigh_agent_pos = agent_map.at(neigh.agent_name).current_pose_.translation();
     neigh.current_position = neigh_agent_pos;
-    neigh.currrent_velocity = agent_map[neigh.agent_name].current_velocity_;
-    neigh.preferred_velocity = agent_map[neigh.agent_name].preferred_velocity_;
-    neigh.max_vel = agent_map[neigh.agent_name].v_max_;
+    neigh.currrent_velocity = agent_map.at(neigh.agent_name).current_velocity_;
+    neigh.preferred_velocity = agent_map.at(neigh.agent_name).preferred_velocity_;
+    neigh.max_vel = agent_map.at(neigh.agent_name).v_max_;
+    if(USE_PATH_PREDICTION == 1)
+      neigh.has_prediction = agent_map.at(neigh.agent_name).predictPath(PREDICTION_HORIZON, neigh);
     neighbors_list_.push_back(neigh);
   }
 
   for(int i=0;i<repulsion_neighbours.size();i++) {
     rvo_agent_obstacle_info_s neigh;
     neigh.agent_name = repulsion_neighbours[i];
-    if(AreSame(agent_map[neigh.agent_name].preferred_velocity_.x(),0.0) && AreSame(agent_map[neigh.agent_name].preferred_velocity_.y(),0.0))
+    if(AreSame(agent_map.at(neigh.agent_name).preferred_velocity_.x(),0.0) && AreSame(agent_map.at(neigh.agent_name).preferred_velocity_.y(),0.0))
       continue;
-    RVO::Vector2 neigh_agent_pos(agent_map[neigh.agent_name].current_pose_.transform.translation.x,
-                                  agent_map[neigh.agent_name].current_pose_.transform.translation.y);
+    RVO::Vector2 neigh_agent_pos = agent_map.at(neigh.agent_name).current_pose_.translation();
     neigh.current_position = neigh_agent_pos;
-    neigh.currrent_velocity = agent_map[neigh.agent_name].current_velocity_;
-    neigh.preferred_velocity = agent_map[neigh.agent_name].preferred_velocity_;
-    neigh.max_vel = agent_map[neigh.agent_name].v_max_;
+    neigh.currrent_velocity = agent_map.at(neigh.agent_name).current_velocity_;
+    neigh.preferred_velocity = agent_map.at(neigh.agent_name).preferred_velocity_;
+    neigh.max_vel = agent_map.at(neigh.agent_name).v_max_;
     repulsion_list_.push_back(neigh);
   }
 
   return result;
 }
 
+bool Agent::predictPath(double horizon, rvo_agent_obstacle_info_s& neighbor) const
+{
+  // Idle, waiting or searching agents are left to their measured velocity
+  if (current_path_.empty() || current_path_.totalSize() < 2 ||
+      (AreSame(preferred_velocity_.x(), 0.0) && AreSame(preferred_velocity_.y(), 0.0)))
+    return false;
+
+  // Expected progress at the speed the agent is driving at, sampled along the path so its
+  // turns are kept. The path itself was already projected on this tick by updatePreferredVelocity
+  float dt = horizon / PREDICTION_SAMPLES;
+  float max_step = v_max_ * dt;
+  neighbor.prediction_dt = dt;
+  neighbor.predicted_path[0] = current_pose_.translation();
+  for (int k = 1; k <= PREDICTION_SAMPLES; k++) {
+    RVO::Vector2 step = current_path_.pointAt(current_path_.progress() + speed_limit_ * dt * k) - neighbor.predicted_path[k-1];
+    // An agent pushed off its path cannot rejoin it faster than it can drive
+    if (abs(step) > max_step)
+      step = norm(step) * max_step;
+    neighbor.predicted_path[k] = neighbor.predicted_path[k-1] + step;
+  }
+  neighbor.predicted_velocity = (neighbor.predicted_path[1] - neighbor.predicted_path[0]) / dt;
+  return true;
+}
+
 void Agent::publishPreferredVelocityMarker(void) {
 
   // update marker and publish it on ROS
   vel_marker_.header.stamp = ros::Time();
   vel_marker_.id = vel_marker_.id + 1;
-  vel_marker_.pose.position.x = current_pose_.transform.translation.x;
-  vel_marker_.pose.position.y = current_pose_.transform.translation.y;
+  vel_marker_.pose.position.x = current_pose_.x;
+  vel_marker_.pose.position.y = current_pose_.y;
   vel_marker_.pose.position.z = 0.0;
 
   // Set the orientation from preferred velocity direction
-  double yaw = atan2(preferred_velocity_.y(), preferred_velocity_.x());
-  tf2::Matrix3x3 rot;
-  rot.setEulerYPR(yaw,0.0,0.0);
-  tf2::Quaternion quat;
-  rot.getRotation(quat);
-  vel_marker_.pose.orientation.x = quat.x();
-  vel_marker_.pose.orientation.y = quat.y();
-  vel_marker_.pose.orientation.z = quat.z();
-  vel_marker_.pose.orientation.w = quat.w();
+  se2ToQuaternionMsg(SE2::fromDirection(0.0, 0.0, preferred_velocity_.x(), preferred_velocity_.y()), vel_marker_.pose.orientation);
 
   vel_marker_.color.r = 1.0;
   vel_marker_.color.g = 0.0;
@@ -485,20 +495,12 @@ void Agent::publishVOVelocityMarker(bool flag) {
   // update marker and publish it on ROS
   vel_marker_.header.stamp = ros::Time();
   vel_marker_.id = vel_marker_.id + 1;
-  vel_marker_.pose.position.x = current_pose_.transform.translation.x;
-  vel_marker_.pose.position.y = current_pose_.transform.translation.y;
+  vel_marker_.pose.position.x = current_pose_.x;
+  vel_marker_.pose.position.y = current_pose_.y;
   vel_marker_.pose.position.z = 0.0;
 
   // Set the orientation from preferred velocity direction
-  double yaw = atan2(rvo_velocity_.y(), rvo_velocity_.x());
-  tf2::Matrix3x3 rot;
-  rot.setEulerYPR(yaw,0.0,0.0);
-  tf2::Quaternion quat;
-  rot.getRotation(quat);
-  vel_marker_.pose.orientation.x = quat.x();
-  vel_marker_.pose.orientation.y = quat.y();
-  vel_marker_.pose.orientation.z = quat.z();
-  vel_marker_.pose.orientation.w = quat.w();
+  se2ToQuaternionMsg(SE2::fromDirection(0.0, 0.0, rvo_velocity_.x(), rvo_velocity_.y()), vel_marker_.pose.orientation);
 
   if(flag) {
     vel_marker_.color.r = 0.0;
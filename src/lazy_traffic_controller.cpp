@@ -2,44 +2,88 @@
 
 #include "lazy_traffic_controller.hpp"
 #include "mtg_messages/agent_status.h"
-
-
-LazyTrafficController::LazyTrafficController(): controller_active_(true), fleet_status_outdated_(false), map_frame_id_("map"),
-                                            velocity_calc_period_s(0.2), controller_period_s(0.2), nh_("mtg_controller"),tf_listener_(tf_buffer_)  {
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+
+
+LazyTrafficController::LazyTrafficController(): controller_active_(true), fleet_status_outdated_(true), map_frame_id_("map"),
+                                            velocity_calc_period_s(0.2), controller_period_s(0.2),
+                                            pose_frames_(PIPELINE_QUEUE_DEPTH), command_frames_(PIPELINE_QUEUE_DEPTH),
+                                            path_commands_(STAGING_QUEUE_CAPACITY), fleet_updates_(STAGING_QUEUE_CAPACITY),
+                                            agent_frames_(std::make_shared<const std::map<std::string, std::string>>()),
+                                            nh_("mtg_controller"),tf_listener_(tf_buffer_),
+                                            map_nh_(nh_), status_nh_(nh_), service_nh_(nh_),
+                                            map_spinner_(1, &map_queue_), service_spinner_(1, &service_queue_),
+                                            map_version_(0), tick_count_(0)  {
+
+    // Commands go out every controller period, avoidance runs every velocity calculation period
+    plan_every_ = std::max(1, (int)std::lround(velocity_calc_period_s/controller_period_s));
+    scheduler_ = UpdateScheduler(USE_ADAPTIVE_UPDATES == 1 ? (uint32_t)std::lround(SCHED_MAX_STALENESS/velocity_calc_period_s) : 1);
+
+    map_nh_.setCallbackQueue(&map_queue_);
+    status_nh_.setCallbackQueue(&status_queue_);
+    service_nh_.setCallbackQueue(&service_queue_);
     
-    status_subscriber_ = nh_.subscribe("/mtg_agent_bringup_node/status", 1, &LazyTrafficController::statusCallback, this);
+    status_subscriber_ = status_nh_.subscribe("/mtg_agent_bringup_node/status", 1, &LazyTrafficController::statusCallback, this);
 
     // subscribe to occupancy grid map
-    occupancy_grid_subscriber_ = nh_.subscribe("/map", 1, &LazyTrafficController::occupancyGridCallback, this);
+    occupancy_grid_subscriber_ = map_nh_.subscribe("/map", 1, &LazyTrafficController::occupancyGridCallback, this);
     // Get latest fleet info from agent bringup
     status_client_ = nh_.serviceClient<mtg_messages::agent_status>("/mtg_agent_bringup_node/agent_status");
-    // Get active agents from agent bringup
-    active_agents = getFleetStatusInfo();
-    ROS_INFO(" [LT_CONTROLLER] Active fleet size %ld",active_agents.size());
-
-    // Initialise agent map
-    initialiseAgentMap(active_agents);
+    // The fleet starts out of date, active agents are fetched from agent bringup by the
+    // controller thread and join at a control tick, the constructor does not wait for them
 
     // Start controller thread
     traffic_controller_thread_ = std::thread(&LazyTrafficController::RunController, this);
 
     // advertise controller service
-    controller_service_ = nh_.advertiseService("lazy_traffic_controller", &LazyTrafficController::controllerServiceCallback, this);
-
-    // Start controller timer
-    controller_timer_ = nh_.createTimer(ros::Duration(controller_period_s),boost::bind(&LazyTrafficController::computeVelocities, this, _1));
+    controller_service_ = service_nh_.advertiseService("lazy_traffic_controller", &LazyTrafficController::controllerServiceCallback, this);
+    path_update_service_ = service_nh_.advertiseService("lazy_traffic_path_update", &LazyTrafficController::pathUpdateServiceCallback, this);
+    map_spinner_.start();
+    service_spinner_.start();
+
+    // Start the control loop, it does not depend on the global spinner
+    timing_publisher_ = nh_.advertise<mtg_controller::ControllerTiming>("/lazy_traffic_controller/timing", 1);
+    control_loop_thread_ = std::thread(&LazyTrafficController::ControlLoop, this);
+    if(PIPELINED_CONTROL_TICK == 1) {
+        compute_thread_ = std::thread(&LazyTrafficController::ComputeStage, this);
+        publish_thread_ = std::thread(&LazyTrafficController::PublishStage, this);
+    }
 }
 
 LazyTrafficController::~LazyTrafficController() {
 
     controller_active_ = false;
+    map_spinner_.stop();
+    service_spinner_.stop();
+    control_loop_thread_.join();
+    if(compute_thread_.joinable())
+        compute_thread_.join();
+    if(publish_thread_.joinable())
+        publish_thread_.join();
     traffic_controller_thread_.join();
 }
 
 // subscribe to occupancy grid map and update the map
 void LazyTrafficController::occupancyGridCallback(const nav_msgs::OccupancyGrid &occupancy_grid_msg) {
-    std::lock_guard<std::mutex> lock(map_mutex);
-    occupancy_grid_map_ = occupancy_grid_msg;
+
+    // The map the control loop handed back after the last swap is freed here, not in the loop
+    std::atomic_store(&retired_map_, std::shared_ptr<StaticMap>());
+
+    // Build the obstacle structures on this thread, they are the expensive part of a map update
+    std::shared_ptr<StaticMap> new_map = std::make_shared<StaticMap>();
+    new_map->pyramid.build(occupancy_grid_msg.data, occupancy_grid_msg.info.width, occupancy_grid_msg.info.height,
+                           occupancy_grid_msg.info.resolution, occupancy_grid_msg.info.origin.position.x,
+                           occupancy_grid_msg.info.origin.position.y);
+    if(USE_INFLATION_LAYER == 1) {
+        new_map->inflation.build(occupancy_grid_msg.data, occupancy_grid_msg.info.width, occupancy_grid_msg.info.height,
+                                 occupancy_grid_msg.info.resolution, occupancy_grid_msg.info.origin.position.x,
+                                 occupancy_grid_msg.info.origin.position.y, RVO_RADIUS_MULT_FACTOR_HOMING*RVO_AGENT_RADIUS);
+    }
+
+    // A map the loop has not picked up yet is simply replaced
+    std::atomic_store(&staged_map_, std::move(new_map));
 }
 
 void LazyTrafficController::statusCallback(const std_msgs::Bool &status_msg) {
@@ -47,158 +91,654 @@ void LazyTrafficController::statusCallback(const std_msgs::Bool &status_msg) {
 }
 
 
+AgentPath LazyTrafficController::ingestPath(std::vector<geometry_msgs::PoseStamped>&& poses) {
+
+    // Planners put the time of each waypoint in z, all zero for a purely geometric path
+    std::vector<RVO::Vector2> points;
+    std::vector<double> times;
+    points.reserve(poses.size());
+    times.reserve(poses.size());
+    for(const auto& pose : poses) {
+        points.push_back(RVO::Vector2(pose.pose.position.x, pose.pose.position.y));
+        times.push_back(pose.pose.position.z);
+    }
+    // Poses are not needed anymore, release them now
+    std::vector<geometry_msgs::PoseStamped>().swap(poses);
+
+    // Drop collinear runs the schedule moves along at constant speed, arc length is computed as the points are added
+    AgentPath path = simplifiedPath(points, times);
+    ROS_DEBUG(" [LT_CONTROLLER] Path simplified from %ld to %ld waypoints", points.size(), path.totalSize());
+    return path;
+}
+
 bool LazyTrafficController::controllerServiceCallback(mtg_messages::mtg_controller::Request &req,
                                                       mtg_messages::mtg_controller::Response &res) {
     
-    std::lock_guard<std::mutex> lock(map_mutex);
+    res.success = true;
     if(req.stop_controller) {
         ROS_INFO(" [LT_CONTROLLER] Emergency stop requested");
-        // TODO
+        PathCommand command;
+        command.op = PathCommand::STOP_ALL;
+        if(!path_commands_.push(std::move(command))) {
+            ROS_ERROR(" [LT_CONTROLLER] Staging queue full, emergency stop dropped");
+            res.success = false;
+            return true;
+        }
+        // Stopping clears every path, pending updates to them are stale
+        for(const auto& agent : *std::atomic_load(&agent_frames_))
+            path_generation_[agent.first]++;
+        return true;
+    }
+
+    ROS_INFO(" [LT_CONTROLLER] New %ld paths received!", req.paths.size());
+    std::shared_ptr<const std::map<std::string, std::string>> agent_frames = std::atomic_load(&agent_frames_);
+    for(int i = 0; i < req.paths.size(); i++) {
+
+        // Ensure agent is already in the map
+        if(agent_frames->count(req.agent_names[i]) == 0) {
+            ROS_ERROR(" [LT_CONTROLLER] Agent %s not found in the map", &req.agent_names[i][0]);
+            continue;
+        }
+        // Planners send thousands of poses per robot, the path is prepared here and not in the loop
+        PathCommand command;
+        command.op = PathCommand::ASSIGN;
+        command.agent_name = req.agent_names[i];
+        command.path = ingestPath(std::move(req.paths[i].poses));
+        if(command.path.empty()) {
+            ROS_ERROR(" [LT_CONTROLLER] Empty path received for agent %s", &req.agent_names[i][0]);
+            continue;
+        }
+        command.stamp = req.paths[i].header.stamp;
+        // If goal type is not specified assume it to be a homing task
+        command.homing = req.goal_type.empty();
+        if(!command.homing)
+            command.goal_type = req.goal_type[i];
+        command.has_goal_id = !req.goal_id.empty();
+        if(command.has_goal_id)
+            command.goal_id = req.goal_id[i];
+        if(!path_commands_.push(std::move(command))) {
+            ROS_ERROR(" [LT_CONTROLLER] Staging queue full, path for agent %s dropped", &req.agent_names[i][0]);
+            res.success = false;
+            continue;
+        }
+        path_generation_[req.agent_names[i]]++;
+    }
+   
+    return true;
+}
+
+bool LazyTrafficController::pathUpdateServiceCallback(mtg_controller::PathUpdate::Request &req,
+                                                      mtg_controller::PathUpdate::Response &res) {
+
+    std::shared_ptr<const std::map<std::string, std::string>> agent_frames = std::atomic_load(&agent_frames_);
+    if(agent_frames->count(req.agent_name) == 0) {
+        ROS_ERROR(" [LT_CONTROLLER] Path update for unknown agent %s", &req.agent_name[0]);
+        res.success = false;
+        res.message = "unknown agent";
+        return true;
+    }
+    uint32_t& last_seq = accepted_seq_[req.agent_name];
+    res.last_seq = last_seq;
+    res.path_gen = path_generation_[req.agent_name];
+
+    // Splice points refer to the path the sender saw, they mean nothing on a newer one.
+    // Commands are applied in the order they are staged, so the generation here is the
+    // one the update will find.
+    if(req.path_gen != res.path_gen) {
+        ROS_WARN(" [LT_CONTROLLER] Path update %u for agent %s targets path %u, tracking path %u",
+                 req.seq, &req.agent_name[0], req.path_gen, res.path_gen);
+        res.success = false;
+        res.message = "path replaced";
+        return true;
+    }
+
+    // Updates can arrive out of order, only newer ones are applied
+    if(req.seq <= last_seq) {
+        ROS_WARN(" [LT_CONTROLLER] Stale path update %u for agent %s, last applied %u",
+                 req.seq, &req.agent_name[0], last_seq);
+        res.success = false;
+        res.message = "stale sequence number";
+        return true;
+    }
+
+    PathCommand command;
+    switch(req.op) {
+        case mtg_controller::PathUpdate::Request::APPEND:
+            command.op = PathCommand::APPEND;
+            break;
+        case mtg_controller::PathUpdate::Request::SPLICE:
+            command.op = PathCommand::SPLICE;
+            break;
+        case mtg_controller::PathUpdate::Request::TRUNCATE:
+            command.op = PathCommand::TRUNCATE;
+            break;
+        default:
+            ROS_ERROR(" [LT_CONTROLLER] Unknown path update op %d for agent %s", req.op, &req.agent_name[0]);
+            res.success = false;
+            res.message = "unknown op";
+            return true;
+    }
+    // Only the new part of the path is sent
+    if(command.op != PathCommand::TRUNCATE)
+        command.path = ingestPath(std::move(req.path.poses));
+    command.agent_name = req.agent_name;
+    command.stamp = req.path.header.stamp;
+    command.splice_s = req.splice_s;
+    if(!path_commands_.push(std::move(command))) {
+        ROS_ERROR(" [LT_CONTROLLER] Staging queue full, path update %u for agent %s dropped", req.seq, &req.agent_name[0]);
+        res.success = false;
+        res.message = "controller busy";
+        return true;
+    }
+
+    // Applied at the start of the next control tick
+    last_seq = req.seq;
+    res.last_seq = req.seq;
+    res.success = true;
+    return true;
+}
+
+// Runs on the control loop at the start of every tick
+void LazyTrafficController::applyStagedUpdates() {
+
+    std::shared_ptr<StaticMap> new_map = std::atomic_exchange(&staged_map_, std::shared_ptr<StaticMap>());
+    if(new_map) {
+        std::swap(occupancy_pyramid_, new_map->pyramid);
+        std::swap(inflation_layer_, new_map->inflation);
+        // Invalidates every agent's static obstacle cache
+        map_version_++;
+        // new_map now holds the old map, hand it back so it is not freed on this thread
+        std::atomic_store(&retired_map_, std::move(new_map));
+    }
+
+    std::set<std::string> fleet;
+    while(fleet_updates_.pop(fleet))
+        processNewAgentStatus(std::move(fleet));
+
+    PathCommand command;
+    while(path_commands_.pop(command))
+        applyPathCommand(command);
+}
+
+void LazyTrafficController::applyPathCommand(PathCommand& command) {
+
+    if(command.op == PathCommand::STOP_ALL) {
         // Stop all agents
         for(auto &agent : agent_map_) {
             agent.second.stopAgent();
             agent.second.clearPath();
         }
+        return;
     }
-    else {
-        ROS_INFO(" [LT_CONTROLLER] New %ld paths received!", req.paths.size());
-        for(int i = 0; i < req.paths.size(); i++) {
-            
-            // Ensure agent is already in the map
-            if(agent_map_.find(req.agent_names[i]) == agent_map_.end()) {
-                ROS_ERROR(" [LT_CONTROLLER] Agent %s not found in the map", &req.agent_names[i][0]);
-                continue;
-            }
-            // Parse path and update agent map
-            if(req.paths[i].poses.size() > 0) {
-                if(req.goal_type.empty()){
-                    // If goal type is not specified assume it to be a homing task
-                    agent_map_[req.agent_names[i]].goal_type_ = mtg_messages::task_graph_getter::Response::FRONTIER;
-                    agent_map_[req.agent_names[i]].goal_threshold_ = 0.4; // increase goal threshold for homing task
-                    agent_map_[req.agent_names[i]].homing_ = true;
-                }
-                else
-                    agent_map_[req.agent_names[i]].goal_type_ = req.goal_type[i];
-                
-                if(!req.goal_id.empty())
-                    agent_map_[req.agent_names[i]].status.goal_id = req.goal_id[i];
-                std::queue<geometry_msgs::PoseStamped> path_queue;
-                for(int j = 0; j < req.paths[i].poses.size(); j++) {
-                    path_queue.push(req.paths[i].poses[j]);
-                }
-                agent_map_[req.agent_names[i]].current_path_ = path_queue;
-                
-                
-            }
-            else {
-                ROS_ERROR(" [LT_CONTROLLER] Empty path received for agent %s", &req.agent_names[i][0]);
-            }
 
-        }
+    auto it = agent_map_.find(command.agent_name);
+    if(it == agent_map_.end()) {
+        ROS_ERROR(" [LT_CONTROLLER] Agent %s not found in the map", &command.agent_name[0]);
+        return;
+    }
+    Agent& agent = it->second;
+    bool was_scheduled = agent.current_path_.scheduled();
+    switch(command.op) {
+        case PathCommand::ASSIGN:
+            if(command.homing) {
+                agent.goal_type_ = mtg_messages::task_graph_getter::Response::FRONTIER;
+                agent.goal_threshold_ = 0.4; // increase goal threshold for homing task
+                agent.homing_ = true;
+            }
+            else
+                agent.goal_type_ = command.goal_type;
+            if(command.has_goal_id)
+                agent.status.goal_id = command.goal_id;
+            // O(1), the old path goes out with the command
+            agent.current_path_.swap(command.path);
+            was_scheduled = false;
+            break;
+        case PathCommand::APPEND:
+            agent.current_path_.append(command.path);
+            break;
+        case PathCommand::SPLICE:
+            agent.current_path_.spliceAt(command.splice_s, command.path);
+            break;
+        case PathCommand::TRUNCATE:
+            agent.current_path_.truncateAt(command.splice_s);
+            break;
+        default:
+            break;
     }
 
-    res.success = true;
-   
-    return true;
+    if(!was_scheduled && agent.current_path_.scheduled()) {
+        // Schedule starts at the path stamp if the planner set one
+        agent.startSchedule(command.stamp.isZero() ? ros::Time::now() : command.stamp);
+        ROS_INFO(" [LT_CONTROLLER] Agent %s tracking a %f s schedule", &command.agent_name[0],
+                 agent.current_path_.time(agent.current_path_.totalSize() - 1));
+    }
+    ROS_DEBUG(" [LT_CONTROLLER] Path command %d for agent %s, %ld waypoints left",
+              command.op, &command.agent_name[0], agent.current_path_.size());
 }
 
+// Agents the services may send paths to and the pose stage looks up, every agent that ever joined the fleet
+void LazyTrafficController::publishAgentFrames() {
+
+    std::shared_ptr<std::map<std::string, std::string>> frames = std::make_shared<std::map<std::string, std::string>>();
+    for(const auto& agent : agent_map_)
+        (*frames)[agent.first] = agent.second.robot_frame_id_;
+    std::atomic_store(&agent_frames_, std::shared_ptr<const std::map<std::string, std::string>>(std::move(frames)));
+}
 
 void LazyTrafficController::RunController() {
 
     ROS_INFO("[LT_CONTROLLER] Opening the floodgates! ");
 
-    ros::Rate r(1);
+    // Spinner of the fleet status queue and fleet discovery worker. A failed fleet
+    // query keeps the fleet out of date and is retried with exponential backoff.
+    double backoff = FLEET_RETRY_MIN;
+    int64_t next_attempt_ns = monotonicNs();
     while(ros::ok() && controller_active_) {
-        ros::spinOnce();
+        double wait = std::max(0.0, (next_attempt_ns - monotonicNs())/(double)NSEC_PER_SEC);
+        if(!fleet_status_outdated_)
+            wait = 1.0;
+        status_queue_.callAvailable(ros::WallDuration(std::min(wait, 1.0)));
+
         // Check if fleet status is outdated
-        if(fleet_status_outdated_) {
-            // TODO: Update agent map
-            ROS_INFO(" [LT_CONTROLLER] Fleet status outdated, updating!!");
-            processNewAgentStatus(getFleetStatusInfo());
-            fleet_status_outdated_ = false;
+        if(monotonicNs() < next_attempt_ns || !fleet_status_outdated_.exchange(false))
+            continue;
+        ROS_INFO(" [LT_CONTROLLER] Fleet status outdated, updating!!");
+        std::set<std::string> fleet;
+        if(getFleetStatusInfo(fleet)) {
+            backoff = FLEET_RETRY_MIN;
+            if(!fleet_updates_.push(std::move(fleet)))
+                ROS_ERROR(" [LT_CONTROLLER] Staging queue full, fleet update dropped");
+        }
+        else {
+            fleet_status_outdated_ = true;
+            next_attempt_ns = monotonicNs() + (int64_t)(backoff*NSEC_PER_SEC);
+            ROS_WARN(" [LT_CONTROLLER] Fleet info not available, retrying in %f s", backoff);
+            backoff = std::min(2.0*backoff, FLEET_RETRY_MAX);
         }
-        
-        r.sleep();
     }
 
 }
 
-void LazyTrafficController::computeVelocities(const ros::TimerEvent&) {
-    
-    std::lock_guard<std::mutex> lock(map_mutex);
+// Pins the calling thread and raises its priority as configured. Either can fail without
+// the privileges for it (CAP_SYS_NICE, rtprio limit), the loop then runs as a normal thread.
+void LazyTrafficController::configureControlThread() {
+
+    if(CONTROL_LOOP_CPU >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(CONTROL_LOOP_CPU, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(err != 0)
+            ROS_WARN(" [LT_CONTROLLER] Could not pin the control loop to CPU %d: %s", CONTROL_LOOP_CPU, strerror(err));
+    }
+    if(CONTROL_LOOP_PRIORITY > 0) {
+        sched_param param;
+        param.sched_priority = CONTROL_LOOP_PRIORITY;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err != 0)
+            ROS_WARN(" [LT_CONTROLLER] Could not set SCHED_FIFO priority %d for the control loop: %s",
+                     CONTROL_LOOP_PRIORITY, strerror(err));
+    }
+}
 
-    static int iter = 1;
-    if(iter == (int)(velocity_calc_period_s/controller_period_s)) {
+void LazyTrafficController::ControlLoop() {
 
-        // Measure execution time of function
-        auto start = std::chrono::high_resolution_clock::now();
+    configureControlThread();
+    if(PIPELINED_CONTROL_TICK == 1) {
+        PoseStage();
+        return;
+    }
 
-        // Update current poses of all agents from tf
-        updateAgentPoses();
-        iter = 1;
+    DeadlineClock clock(controller_period_s);
+    const uint32_t report_ticks = std::max(1, (int)std::lround(TIMING_REPORT_PERIOD/controller_period_s));
+    clock.start();
+    while(ros::ok() && controller_active_) {
 
-        // Calculate preferred velocities for all agents
+        timing_.jitter.add(clock.wait());
+        int64_t start = monotonicNs();
+        applyStagedUpdates();
+        computeVelocities();
+        timing_.tick.add((monotonicNs() - start)/(double)NSEC_PER_SEC);
+
+        uint32_t skipped = clock.finish();
+        if(skipped > 0) {
+            timing_.deadline_misses++;
+            timing_.skipped_ticks += skipped;
+            ROS_WARN_THROTTLE(1.0, " [LT_CONTROLLER] Control tick overran its period of %f s, skipped %u ticks",
+                              controller_period_s, skipped);
+        }
+        if(++timing_.ticks >= report_ticks) {
+            publishTiming();
+            timing_.reset();
+        }
+    }
+}
+
+// Pipelined tick, stage 1 on the control loop thread. Looks up the poses for tick N+1 on the
+// loop deadlines while tick N is computed and tick N-1 is published. When compute is behind
+// the newest poses are dropped, the ones already queued are at most PIPELINE_QUEUE_DEPTH ticks old.
+void LazyTrafficController::PoseStage() {
+
+    DeadlineClock clock(controller_period_s);
+    uint32_t skipped = 0, dropped = 0;
+    clock.start();
+    while(ros::ok() && controller_active_) {
+
+        PoseFrame frame;
+        frame.timing.jitter = clock.wait();
+        frame.timing.skipped = skipped;
+        frame.timing.dropped = dropped;
+        frame.timing.gathered_ns = monotonicNs();
+        std::shared_ptr<const std::map<std::string, std::string>> agent_frames = std::atomic_load(&agent_frames_);
+        frame.poses.reserve(agent_frames->size());
+        for(const auto& agent : *agent_frames) {
+            AgentPose pose;
+            pose.name = agent.first;
+            if(lookupPose(agent.second, pose.pose, pose.stamp))
+                frame.poses.push_back(std::move(pose));
+        }
+        frame.timing.poses = (monotonicNs() - frame.timing.gathered_ns)/(double)NSEC_PER_SEC;
+
+        if(pose_frames_.push(std::move(frame)))
+            dropped = 0;
+        else {
+            dropped++;
+            ROS_WARN_THROTTLE(1.0, " [LT_CONTROLLER] Compute stage behind, pose frame dropped");
+        }
+        skipped = clock.finish();
+        if(skipped > 0)
+            ROS_WARN_THROTTLE(1.0, " [LT_CONTROLLER] Pose stage overran its period of %f s, skipped %u ticks",
+                              controller_period_s, skipped);
+    }
+}
+
+// Pipelined tick, stage 2. Owns the agents like the sequential loop does.
+void LazyTrafficController::ComputeStage() {
+
+    PoseFrame frame;
+    while(ros::ok() && controller_active_) {
+
+        if(!pose_frames_.pop(frame, controller_period_s))
+            continue;
+        int64_t start = monotonicNs();
+        applyStagedUpdates();
+        for(const auto& pose : frame.poses) {
+            auto it = agent_map_.find(pose.name);
+            if(it != agent_map_.end())
+                applyPose(it->second, pose.pose, pose.stamp);
+        }
+
+        // Avoidance at the planning rate, as in the sequential tick
+        bool plan = tick_count_++ % plan_every_ == 0;
+        int64_t preferred_done = monotonicNs(), obstacles_done = preferred_done;
+        uint32_t cache_hits = 0, cache_misses = 0;
+        if(plan) {
+            // Calculate preferred velocities for all agents
+            for(auto &agent : agent_map_)
+                agent.second.updatePreferredVelocity();
+            preferred_done = monotonicNs();
+
+            // One obstacle sweep for the whole fleet
+            computeFleetObstacles(cache_hits, cache_misses);
+            obstacles_done = monotonicNs();
+        }
+
+        CommandFrame commands;
+        commands.commands.reserve(agent_map_.size());
         for(auto &agent : agent_map_) {
-            agent.second.updatePreferredVelocity();
-            agent.second.invokeRVO(agent_map_, occupancy_grid_map_);
+            if(plan)
+                planAgent(agent.second);
 
-            agent.second.sendVelocity(agent.second.rvo_velocity_);
+            AgentCommand command;
+            if(agent.second.computeCommand(agent.second.rvo_velocity_, command))
+                commands.commands.push_back(std::move(command));
             // Inform other subsystems of the controller status
-            agent.second.publishStatus();
+            if(plan)
+                agent.second.publishStatus();
         }
 
-        auto finish = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed = finish - start;
-        //ROS_INFO(" [LT_CONTROLLER] Time taken to compute velocities: %f s", elapsed.count());
+        commands.timing = frame.timing;
+        commands.timing.preferred = (preferred_done - start)/(double)NSEC_PER_SEC;
+        commands.timing.obstacles = (obstacles_done - preferred_done)/(double)NSEC_PER_SEC;
+        commands.timing.avoidance = (monotonicNs() - obstacles_done)/(double)NSEC_PER_SEC;
+        commands.timing.cache_hits = cache_hits;
+        commands.timing.cache_misses = cache_misses;
+        // Publishing does next to nothing, it falling behind means the process is starved.
+        // A frame with a stop in it waits for room instead, a stop is only sent once.
+        bool stops = std::any_of(commands.commands.begin(), commands.commands.end(),
+                                 [](const AgentCommand& command) { return command.stop; });
+        while(!command_frames_.push(std::move(commands))) {
+            if(!stops || !controller_active_) {
+                ROS_ERROR_THROTTLE(1.0, " [LT_CONTROLLER] Publish stage behind, commands dropped");
+                break;
+            }
+            std::this_thread::yield();
+        }
     }
-    else {
-        iter++;
-         for(auto &agent : agent_map_) {
-            
-            // Velocity is not sent if it is already zero
-            agent.second.sendVelocity(agent.second.rvo_velocity_);
+}
+
+// Pipelined tick, stage 3. Sends the commands and accounts for the whole tick.
+void LazyTrafficController::PublishStage() {
+
+    const uint32_t report_ticks = std::max(1, (int)std::lround(TIMING_REPORT_PERIOD/controller_period_s));
+    CommandFrame frame;
+    while(ros::ok() && controller_active_) {
+
+        if(!command_frames_.pop(frame, controller_period_s))
+            continue;
+        int64_t start = monotonicNs();
+        for(const auto& command : frame.commands)
+            command.publisher.publish(command.twist);
+        int64_t done = monotonicNs();
+
+        const TickTiming& tick = frame.timing;
+        double publish = (done - start)/(double)NSEC_PER_SEC;
+        timing_.jitter.add(tick.jitter);
+        if(tick.skipped > 0) {
+            timing_.deadline_misses++;
+            timing_.skipped_ticks += tick.skipped;
+        }
+        timing_.dropped_frames += tick.dropped;
+        timing_.cache_hits += tick.cache_hits;
+        timing_.cache_misses += tick.cache_misses;
+        timing_.poses.add(tick.poses);
+        timing_.preferred.add(tick.preferred);
+        timing_.obstacles.add(tick.obstacles);
+        timing_.avoidance.add(tick.avoidance);
+        timing_.publish.add(publish);
+        timing_.tick.add(tick.poses + tick.preferred + tick.obstacles + tick.avoidance + publish);
+        timing_.delay.add((done - tick.gathered_ns)/(double)NSEC_PER_SEC);
+        if(++timing_.ticks >= report_ticks) {
+            publishTiming();
+            timing_.reset();
         }
     }
+}
 
+void LazyTrafficController::publishTiming() {
+
+    mtg_controller::ControllerTiming msg;
+    msg.header.stamp = ros::Time::now();
+    msg.period = controller_period_s;
+    msg.ticks = timing_.ticks;
+    msg.deadline_misses = timing_.deadline_misses;
+    msg.skipped_ticks = timing_.skipped_ticks;
+    msg.jitter_mean = timing_.jitter.mean();
+    msg.jitter_max = timing_.jitter.max;
+    msg.tick_mean = timing_.tick.mean();
+    msg.tick_max = timing_.tick.max;
+    msg.poses_mean = timing_.poses.mean();
+    msg.poses_max = timing_.poses.max;
+    msg.preferred_mean = timing_.preferred.mean();
+    msg.preferred_max = timing_.preferred.max;
+    msg.obstacles_mean = timing_.obstacles.mean();
+    msg.obstacles_max = timing_.obstacles.max;
+    msg.avoidance_mean = timing_.avoidance.mean();
+    msg.avoidance_max = timing_.avoidance.max;
+    msg.publish_mean = timing_.publish.mean();
+    msg.publish_max = timing_.publish.max;
+    msg.delay_mean = timing_.delay.mean();
+    msg.delay_max = timing_.delay.max;
+    msg.dropped_frames = timing_.dropped_frames;
+    msg.obstacle_cache_hits = timing_.cache_hits;
+    msg.obstacle_cache_misses = timing_.cache_misses;
+    timing_publisher_.publish(msg);
 }
 
-    
+void LazyTrafficController::computeVelocities() {
+
+    // Fresh poses every command tick, so every command turns from the current heading
+    int64_t start = monotonicNs();
+    updateAgentPoses();
+    int64_t poses_done = monotonicNs();
+    timing_.poses.add((poses_done - start)/(double)NSEC_PER_SEC);
+
+    // Avoidance runs at the planning rate, the ticks in between track the last planned velocities
+    bool plan = tick_count_++ % plan_every_ == 0;
+    int64_t obstacles_done = poses_done;
+    if(plan) {
+        // Calculate preferred velocities for all agents
+        for(auto &agent : agent_map_)
+            agent.second.updatePreferredVelocity();
+        int64_t preferred_done = monotonicNs();
+
+        // One obstacle sweep for the whole fleet
+        computeFleetObstacles(timing_.cache_hits, timing_.cache_misses);
+        obstacles_done = monotonicNs();
+        timing_.preferred.add((preferred_done - poses_done)/(double)NSEC_PER_SEC);
+        timing_.obstacles.add((obstacles_done - preferred_done)/(double)NSEC_PER_SEC);
+    }
+
+    for(auto &agent : agent_map_) {
+        if(plan)
+            planAgent(agent.second);
+
+        // Velocity is not sent if it is already zero
+        agent.second.sendVelocity(agent.second.rvo_velocity_);
+        // Inform other subsystems of the controller status
+        if(plan)
+            agent.second.publishStatus();
+    }
+    int64_t done = monotonicNs();
+    timing_.avoidance.add((done - obstacles_done)/(double)NSEC_PER_SEC);
+    // From the pose lookups to the last command sent, as in the pipelined tick
+    timing_.delay.add((done - start)/(double)NSEC_PER_SEC);
+}
+
+// Avoidance for one agent on a planning tick. An agent whose last update found it at low
+// risk holds its planned velocity until its schedule says otherwise. Agents that stop or
+// start moving, or whose preferred velocity changed since the update, are always updated
+// so they do not hold a velocity that is no longer wanted. RVO assumes both agents of a
+// pair avoid each other, so an agent found closing in on others wakes them up as well.
+void LazyTrafficController::planAgent(Agent& agent) {
+
+    bool due = agent.update_schedule_.tick();
+    bool holding = !(AreSame(agent.rvo_velocity_.x(), 0.0) && AreSame(agent.rvo_velocity_.y(), 0.0));
+    bool replanned = abs(agent.preferred_velocity_ - agent.planned_preferred_) > SCHED_HOLD_TOLERANCE;
+    if(!due && holding && !replanned && agent.requiresAvoidance())
+        return;
+
+    agent.invokeRVO(agent_map_, inflation_layer_);
+    agent.planned_preferred_ = agent.preferred_velocity_;
+    if(!agent.requiresAvoidance()) {
+        agent.update_schedule_.updated(1);
+        return;
+    }
+    std::vector<std::string> closing;
+    agent.update_schedule_.updated(scheduler_.interval(agent.assessRisk(&closing)));
+    for(const auto& name : closing) {
+        // Static obstacles are neighbors too, only agents have a schedule
+        auto it = agent_map_.find(name);
+        if(it != agent_map_.end())
+            it->second.update_schedule_.wake();
+    }
+}
+
+// Adds the static obstacle cache hits and misses of this sweep to the counters given
+void LazyTrafficController::computeFleetObstacles(uint32_t& cache_hits, uint32_t& cache_misses) {
+
+    if(USE_STATIC_OBSTACLE_AVOIDANCE != 1 || USE_INFLATION_LAYER == 1)
+        return;
+
+    if(occupancy_pyramid_.empty())
+        return;
+
+    // Only agents that will run avoidance this tick and have left their cached cell need a sweep.
+    // The search disk is centred on the cell so that the result is the same anywhere inside it.
+    std::vector<Agent*> members;
+    std::vector<std::pair<int,int>> cells;
+    std::vector<RVO::Vector2> centres;
+    float resolution = occupancy_pyramid_.resolution();
+    for(auto &agent : agent_map_) {
+        if(!agent.second.requiresAvoidance())
+            continue;
+        int cell_x = (int)std::floor((agent.second.current_pose_.x - occupancy_pyramid_.originX())/resolution);
+        int cell_y = (int)std::floor((agent.second.current_pose_.y - occupancy_pyramid_.originY())/resolution);
+        if(agent.second.lookupStaticObstacleCache(map_version_, cell_x, cell_y)) {
+            cache_hits++;
+            continue;
+        }
+        cache_misses++;
+        members.push_back(&agent.second);
+        cells.push_back(std::make_pair(cell_x, cell_y));
+        centres.push_back(RVO::Vector2(occupancy_pyramid_.originX() + resolution*(cell_x + 0.5f),
+                                       occupancy_pyramid_.originY() + resolution*(cell_y + 0.5f)));
+    }
+
+    if(members.empty())
+        return;
+    fleet_obstacles_.build(occupancy_pyramid_, centres, MAX_STATIC_OBS_DIST);
+    for(size_t i = 0; i < members.size(); i++)
+        members[i]->setStaticObstacles(fleet_obstacles_, i, map_version_, cells[i].first, cells[i].second);
+}
 
 void LazyTrafficController::updateAgentPoses() {
     
     for(auto it = agent_map_.begin(); it != agent_map_.end(); it++) {
         // Get current pose of agent
-        geometry_msgs::TransformStamped current_pose;
-        try {
-            current_pose = tf_buffer_.lookupTransform(map_frame_id_, it->second.robot_frame_id_, ros::Time(0));
-        }
-        catch (tf2::TransformException &ex) {
-            ROS_WARN("%s",ex.what());
-            //ros::Duration(1.0).sleep();
-            continue;
-        }
-        // Calculate current velocity
-        // Change in x
-        double dx = current_pose.transform.translation.x - it->second.current_pose_.transform.translation.x;
-        // Change in y
-        double dy = current_pose.transform.translation.y - it->second.current_pose_.transform.translation.y;
-        double dt = velocity_calc_period_s;
-        assert(!AreSame(dt,0.0));
-        // Calculate current velocity
-        it->second.current_velocity_ = RVO::Vector2(dx/dt, dy/dt);
+        SE2 pose;
+        ros::Time stamp;
+        if(lookupPose(it->second.robot_frame_id_, pose, stamp))
+            applyPose(it->second, pose, stamp);
+    }
+}
+
+// Latest pose of frame_id in the map frame and its stamp, false if TF does not have it
+bool LazyTrafficController::lookupPose(const std::string& frame_id, SE2& pose, ros::Time& stamp) {
+
+    geometry_msgs::TransformStamped current_pose;
+    try {
+        current_pose = tf_buffer_.lookupTransform(map_frame_id_, frame_id, ros::Time(0));
+    }
+    catch (tf2::TransformException &ex) {
+        ROS_WARN("%s",ex.what());
+        //ros::Duration(1.0).sleep();
+        return false;
+    }
+    // Only the planar pose is used from here on
+    pose = se2FromTransformMsg(current_pose.transform);
+    stamp = current_pose.header.stamp;
+    return true;
+}
+
+void LazyTrafficController::applyPose(Agent& agent, const SE2& pose, const ros::Time& stamp) {
 
-        // Update current pose
-        it->second.current_pose_ = current_pose;
-        // ROS_INFO(" [LT_CONTROLLER] Updated pose of %s %f %f", it->first.c_str(), 
-        //                     agent_map_[it->first.c_str()].current_pose_.transform.translation.x, 
-        //                     agent_map_[it->first.c_str()].current_pose_.transform.translation.y);
-        // ROS_INFO(" [LT_CONTROLLER] Updated velocity of %s %f %f", it->first.c_str(), 
-        //                         it->second.current_velocity_.x(), it->second.current_velocity_.y());
+    // Velocity over the time between the two poses' stamps, poses are looked up every
+    // command tick and TF does not necessarily have a newer one each time
+    if(!agent.pose_stamp_.isZero()) {
+        double dt = (stamp - agent.pose_stamp_).toSec();
+        if(dt <= 0.0)
+            return;
+        // Calculate current velocity
+        agent.current_velocity_ = RVO::Vector2((pose.x - agent.current_pose_.x)/dt, (pose.y - agent.current_pose_.y)/dt);
     }
+
+    // Update current pose
+    agent.current_pose_ = pose;
+    agent.pose_stamp_ = stamp;
 }
 void LazyTrafficController::processNewAgentStatus(std::set<string> new_fleet_info) {
 
-    std::lock_guard<std::mutex> lock(map_mutex);
     // Get newly added agents
     std::set<string> additions;
     std::set<string> subtractions;
@@ -212,6 +752,8 @@ void LazyTrafficController::processNewAgentStatus(std::set<string> new_fleet_inf
         // Add them to our fleet info!
         active_agents.insert(additions.begin(),additions.end());
         initialiseAgentMap(additions);
+        publishAgentFrames();
+        ROS_INFO(" [LT_CONTROLLER] Active fleet size %ld",active_agents.size());
     }
     if(!subtractions.empty()) {
         // Dont destroy the action server for now
@@ -231,27 +773,44 @@ void LazyTrafficController::initialiseAgentMap(std::set<std::string> active_agen
     for (auto agent : active_agents) {
         ROS_INFO(" [LT_CONTROLLER] Initialising agent %s", agent.c_str());
         agent_map_[agent] = Agent(agent, nh_);
+        agent_map_[agent].setControlPeriod(controller_period_s);
     }
 }
 
-std::set<std::string> LazyTrafficController::getFleetStatusInfo() {
+// Fleet query with a bounded wait for the agent bringup service, false if it failed
+bool LazyTrafficController::getFleetStatusInfo(std::set<std::string>& agents) {
 
-    mtg_messages::agent_status srv;
     // wait for service to be available
-    status_client_.waitForExistence();
-
-    if (status_client_.call(srv)) {
-        std::vector<std::string> agentsVec = srv.response.agents_active;
-        std::set<std::string> agentsSet;
+    if(!status_client_.waitForExistence(ros::Duration(FLEET_SERVICE_TIMEOUT))) {
+        ROS_WARN(" [LT_CONTROLLER] Fleet info service not up after %f s", FLEET_SERVICE_TIMEOUT);
+        return false;
+    }
 
-        for(auto agent:agentsVec)
-            agentsSet.insert(agent);
+    // A service call has no timeout of its own, it runs on a thread of its own so a bringup node
+    // that hangs mid call only holds that thread. A call left over from a failed attempt is
+    // waited on again rather than started a second time.
+    if(!fleet_call_.valid()) {
+        std::shared_ptr<mtg_messages::agent_status> srv = std::make_shared<mtg_messages::agent_status>();
+        std::shared_ptr<std::promise<bool>> done = std::make_shared<std::promise<bool>>();
+        fleet_call_ = done->get_future();
+        fleet_srv_ = srv;
+        std::string service = status_client_.getService();
+        std::thread([service, srv, done]() { done->set_value(ros::service::call(service, *srv)); }).detach();
+    }
+    if(fleet_call_.wait_for(std::chrono::duration<double>(FLEET_SERVICE_TIMEOUT)) != std::future_status::ready) {
+        ROS_WARN(" [LT_CONTROLLER] Fleet info service did not answer within %f s", FLEET_SERVICE_TIMEOUT);
+        return false;
+    }
 
-        return agentsSet;
+    if (fleet_call_.get()) {
+        agents.clear();
+        for(auto agent:fleet_srv_->response.agents_active)
+            agents.insert(agent);
+        return true;
     }
     else
     {
         ROS_ERROR("[LT_CONTROLLER] Failed to call fleet info service");
-        return active_agents;
+        return false;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,45 @@
+// Runs the LG controller action servers of a whole fleet in one process
+
+#include <memory>
+#include <vector>
+
+#include <ros/ros.h>
+#include "lg_action_server.hpp"
+
+// All servers share one TF buffer and are stepped by one timer, so adding a robot
+// adds neither a /tf subscription nor a timer. Each SimpleActionServer still runs
+// its own execute thread, which only sleeps while its goal is tracked; a control
+// step and that thread's goal handover are serialized per server by tick_mutex_.
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "mtg_lg_action_server_host");
+  ros::NodeHandle nh;
+
+  // Agent names are the remaining command line arguments
+  if (argc < 2)
+  {
+    ROS_ERROR("[LG_HOST] Usage: mtg_lg_action_server_host agent_name [agent_name ...]");
+    return (1);
+  }
+
+  tf2_ros::Buffer tf_buffer;
+  tf2_ros::TransformListener tf_listener(tf_buffer);
+
+  std::vector<std::unique_ptr<LGControllerAction>> servers;
+  for (int i = 1; i < argc; i++)
+  {
+    ROS_INFO("[LG_HOST] Hosting action server for %s", argv[i]);
+    servers.emplace_back(new LGControllerAction(argv[i], &tf_buffer));
+  }
+
+  // Goals are still handled per server, the timer only steps the ones tracking a goal
+  ros::Timer controller_timer = nh.createTimer(ros::Duration(servers.front()->controllerPeriod()),
+                                               [&servers](const ros::TimerEvent &event) {
+                                                 for (auto &server : servers)
+                                                   server->tick(event);
+                                               });
+
+  ros::spin();
+
+  return (0);
+}
@@ -0,0 +1,70 @@
+// Per step cost of the pure pursuit tracker for paths of 10 to 100k waypoints
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "pure_pursuit_tracker.hpp"
+
+#define BENCHMARK_STEPS (200000) // Tracking steps timed per path length
+#define BENCHMARK_SPACING (0.05) // Distance (m) between waypoints
+#define BENCHMARK_SPEED (0.3) // Robot speed (m/s)
+#define BENCHMARK_PERIOD (0.2) // Controller period (s)
+#define BENCHMARK_LOOKAHEAD (0.4)
+
+// Sine wave along x, so the tracker also sees curvature
+AgentPath makePath(size_t n)
+{
+  AgentPath path;
+  path.reserve(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    double x = i * BENCHMARK_SPACING;
+    path.push_back(RVO::Vector2(x, 0.5 * sin(0.5 * x)));
+  }
+  return path;
+}
+
+int main(int argc, char **argv)
+{
+  const size_t lengths[] = {10, 100, 1000, 10000, 100000};
+  PurePursuitTracker tracker;
+
+  printf("%10s %10s %12s %12s\n", "waypoints", "steps", "ns/step", "turning");
+  for (size_t n : lengths)
+  {
+    const AgentPath base = makePath(n);
+    AgentPath path;
+    double elapsed_ns = 0.0;
+    double checksum = 0.0;
+    size_t steps = 0;
+
+    while (steps < BENCHMARK_STEPS)
+    {
+      // Restart at the beginning of the path, not timed
+      path = base;
+      RVO::Vector2 position = path[0] + RVO::Vector2(0.0, 0.05);
+
+      auto start = std::chrono::high_resolution_clock::now();
+      while (steps < BENCHMARK_STEPS)
+      {
+        PurePursuitTarget target = tracker.step(path, position, BENCHMARK_LOOKAHEAD);
+        checksum += path.turning(target.progress, target.s);
+        steps++;
+        if (target.end_of_path)
+          break;
+        // Drive straight at the lookahead point
+        RVO::Vector2 direction = target.point - position;
+        if (absSq(direction) > 0.0f)
+          position += norm(direction) * (float)(BENCHMARK_SPEED * BENCHMARK_PERIOD);
+      }
+      auto finish = std::chrono::high_resolution_clock::now();
+      elapsed_ns += std::chrono::duration<double, std::nano>(finish - start).count();
+    }
+
+    printf("%10zu %10zu %12.1f %12.3f\n", n, steps, elapsed_ns / steps, checksum);
+  }
+
+  return (0);
+}
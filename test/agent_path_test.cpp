@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include "lazy_traffic_path.hpp"
+
+TEST(PathCursor, PathCursor){
+
+    AgentPath path;
+    ASSERT_TRUE(path.empty());
+    for(int i = 0; i < 5; i++)
+        path.push_back(RVO::Vector2(0.1*i, 0.0));
+
+    ASSERT_EQ(5, path.size());
+    path.pop();
+    ASSERT_EQ(4, path.size());
+    ASSERT_FLOAT_EQ(0.1, path.front().x());
+
+    // Cursor never moves backwards
+    path.advanceTo(3);
+    path.advanceTo(2);
+    ASSERT_EQ(3, path.cursor());
+    ASSERT_EQ(2, path.size());
+    ASSERT_EQ(5, path.totalSize());
+
+    path.pop();
+    path.pop();
+    ASSERT_TRUE(path.empty());
+    ASSERT_EQ(0, path.size());
+}
+
+TEST(PathArcLength, PathArcLength){
+
+    // L shaped path with uneven waypoint spacing
+    AgentPath path;
+    path.push_back(RVO::Vector2(0.0, 0.0));
+    path.push_back(RVO::Vector2(0.1, 0.0));
+    path.push_back(RVO::Vector2(1.0, 0.0));
+    path.push_back(RVO::Vector2(1.0, 2.0));
+
+    ASSERT_NEAR(3.0, path.length(), 1e-6);
+    ASSERT_NEAR(1.0, path.arcLength(2), 1e-6);
+    ASSERT_EQ(1, path.segmentAt(0.5));
+    ASSERT_EQ(2, path.segmentAt(10.0));
+    ASSERT_EQ(0, path.segmentAt(-1.0));
+
+    // Interpolated and clamped
+    ASSERT_NEAR(0.4, path.pointAt(0.4).x(), 1e-6);
+    ASSERT_NEAR(1.0, path.pointAt(1.5).x(), 1e-6);
+    ASSERT_NEAR(0.5, path.pointAt(1.5).y(), 1e-6);
+    ASSERT_NEAR(2.0, path.pointAt(5.0).y(), 1e-6);
+    ASSERT_NEAR(0.0, path.pointAt(-1.0).x(), 1e-6);
+}
+
+TEST(PathTurning, PathTurning){
+
+    // Straight, 90 degree left corner, straight, 45 degree right corner
+    AgentPath path;
+    path.push_back(RVO::Vector2(0.0, 0.0));
+    path.push_back(RVO::Vector2(1.0, 0.0));
+    path.push_back(RVO::Vector2(1.0, 1.0));
+    path.push_back(RVO::Vector2(1.0, 2.0));
+    path.push_back(RVO::Vector2(2.0, 3.0));
+
+    ASSERT_NEAR(0.0, path.turning(0.0, 0.9), 1e-6);
+    ASSERT_NEAR(M_PI/2, path.turning(0.5, 1.5), 1e-6);
+    ASSERT_NEAR(0.0, path.turning(1.5, 1.9), 1e-6);
+    ASSERT_NEAR(M_PI/2 + M_PI/4, path.turning(0.0, path.length()), 1e-6);
+    ASSERT_NEAR(0.0, path.turning(2.5, 2.0), 1e-6);
+}
+
+TEST(PathSchedule, PathSchedule){
+
+    // 1 m at 0.5 m/s, wait 1 s, then 1 m at 0.25 m/s
+    AgentPath path;
+    path.push_back(RVO::Vector2(0.0, 0.0), 0.0);
+    path.push_back(RVO::Vector2(1.0, 0.0), 2.0);
+    path.push_back(RVO::Vector2(1.0, 0.0), 3.0);
+    path.push_back(RVO::Vector2(2.0, 0.0), 7.0);
+    ASSERT_TRUE(path.scheduled());
+
+    ASSERT_NEAR(0.0, path.scheduledArcLength(-1.0), 1e-9);
+    ASSERT_NEAR(0.5, path.scheduledArcLength(1.0), 1e-9);
+    ASSERT_NEAR(1.0, path.scheduledArcLength(2.5), 1e-9);
+    ASSERT_NEAR(1.5, path.scheduledArcLength(5.0), 1e-9);
+    ASSERT_NEAR(2.0, path.scheduledArcLength(10.0), 1e-9);
+
+    ASSERT_NEAR(1.0, path.scheduledTime(0.5), 1e-9);
+    ASSERT_NEAR(5.0, path.scheduledTime(1.5), 1e-9);
+
+    ASSERT_NEAR(0.5, path.scheduledSpeed(1.0), 1e-9);
+    ASSERT_NEAR(0.0, path.scheduledSpeed(2.5), 1e-9);
+    ASSERT_NEAR(0.25, path.scheduledSpeed(4.0), 1e-9);
+    ASSERT_NEAR(0.0, path.scheduledSpeed(8.0), 1e-9);
+
+    // All zero or decreasing times are not a schedule
+    AgentPath geometric;
+    geometric.push_back(RVO::Vector2(0.0, 0.0));
+    geometric.push_back(RVO::Vector2(1.0, 0.0));
+    ASSERT_FALSE(geometric.scheduled());
+    AgentPath unordered;
+    unordered.push_back(RVO::Vector2(0.0, 0.0), 1.0);
+    unordered.push_back(RVO::Vector2(1.0, 0.0), 0.5);
+    ASSERT_FALSE(unordered.scheduled());
+    path.clear();
+    ASSERT_FALSE(path.scheduled());
+}
+
+TEST(PathUpdate, PathUpdate){
+
+    // Straight line along x, tracked up to x = 2.5
+    AgentPath path;
+    for(int i = 0; i <= 4; i++)
+        path.push_back(RVO::Vector2(i, 0.0));
+    path.track(RVO::Vector2(1.2, 0.0));
+    path.track(RVO::Vector2(2.5, 0.0));
+    ASSERT_EQ(2, path.cursor());
+
+    // Append a left turn, the cursor and progress carry over
+    AgentPath tail;
+    tail.push_back(RVO::Vector2(4.0, 1.0));
+    tail.push_back(RVO::Vector2(4.0, 2.0));
+    path.append(tail);
+    ASSERT_EQ(7, path.totalSize());
+    ASSERT_EQ(2, path.cursor());
+    ASSERT_NEAR(2.5, path.progress(), 1e-6);
+    ASSERT_NEAR(6.0, path.length(), 1e-6);
+    ASSERT_NEAR(M_PI/2, path.turning(3.5, 4.5), 1e-6);
+
+    // Truncate in the middle of a segment, the cut point becomes the end
+    path.truncateAt(4.5);
+    ASSERT_EQ(6, path.totalSize());
+    ASSERT_NEAR(4.5, path.length(), 1e-6);
+    ASSERT_NEAR(0.5, path.back().y(), 1e-6);
+    ASSERT_NEAR(M_PI/2, path.turning(3.5, 4.5), 1e-6);
+
+    // Splice at a waypoint, the turn there is recomputed for the new tail
+    AgentPath detour;
+    detour.push_back(RVO::Vector2(5.0, 0.0));
+    path.spliceAt(3.0, detour);
+    ASSERT_EQ(5, path.totalSize());
+    ASSERT_NEAR(5.0, path.back().x(), 1e-6);
+    ASSERT_NEAR(0.0, path.turning(0.0, path.length()), 1e-6);
+    ASSERT_EQ(2, path.cursor());
+    ASSERT_NEAR(2.5, path.progress(), 1e-6);
+
+    // Truncating behind the robot clamps the cursor and progress
+    path.truncateAt(1.0);
+    ASSERT_EQ(2, path.totalSize());
+    ASSERT_EQ(1, path.cursor());
+    ASSERT_NEAR(1.0, path.progress(), 1e-6);
+
+    // Schedule times are interpolated at the cut
+    AgentPath scheduled;
+    scheduled.push_back(RVO::Vector2(0.0, 0.0), 0.0);
+    scheduled.push_back(RVO::Vector2(2.0, 0.0), 4.0);
+    scheduled.truncateAt(1.0);
+    ASSERT_TRUE(scheduled.scheduled());
+    ASSERT_NEAR(2.0, scheduled.time(1), 1e-9);
+}
+
+TEST(PathTracking, PathTracking){
+
+    // Coverage style path going out and coming back 0.5 m away
+    AgentPath path;
+    for(int i = 0; i < 100; i++)
+        path.push_back(RVO::Vector2(0.1*i, 0.0));
+    for(int i = 99; i >= 0; i--)
+        path.push_back(RVO::Vector2(0.1*i, 0.5));
+
+    // The return leg is outside the projection window
+    ASSERT_NEAR(1.0, path.track(RVO::Vector2(1.0, 0.3)), 1e-4);
+    ASSERT_NEAR(1.55, path.track(RVO::Vector2(1.55, 0.1)), 1e-4);
+    ASSERT_EQ(15, path.cursor());
+
+    // Pushed backwards : progress follows, cursor does not
+    ASSERT_NEAR(1.2, path.track(RVO::Vector2(1.2, -0.1)), 1e-4);
+    ASSERT_EQ(15, path.cursor());
+
+    // Far from the current progress the robot is not snapped ahead
+    ASSERT_LT(path.track(RVO::Vector2(8.0, 0.0)), 3.0);
+}
+
+TEST(PathSimplify, PathSimplify){
+
+    // Dense straight line with a corner and a zig-zag that doubles back
+    std::vector<RVO::Vector2> points;
+    for(int i = 0; i <= 100; i++)
+        points.push_back(RVO::Vector2(0.01*i, 0.0));
+    for(int i = 1; i <= 100; i++)
+        points.push_back(RVO::Vector2(1.0, 0.01*i));
+    for(int i = 1; i <= 50; i++)
+        points.push_back(RVO::Vector2(1.0, 1.0 - 0.01*i));
+
+    std::vector<size_t> kept = simplifyPolyline(points, PATH_SIMPLIFY_TOLERANCE);
+    ASSERT_EQ(4, kept.size());
+    ASSERT_EQ(0, kept[0]);
+    ASSERT_EQ(100, kept[1]);
+    ASSERT_EQ(200, kept[2]);
+    ASSERT_EQ(250, kept[3]);
+
+    // Every dropped point stays within tolerance of the simplified path
+    for(size_t k = 0; k + 1 < kept.size(); k++) {
+        for(size_t i = kept[k]; i <= kept[k+1]; i++)
+            ASSERT_LE(distanceToSegment(points[i], points[kept[k]], points[kept[k+1]]), PATH_SIMPLIFY_TOLERANCE);
+    }
+
+    // Short paths are kept as they are
+    std::vector<RVO::Vector2> two_points = {RVO::Vector2(0.0, 0.0), RVO::Vector2(0.0, 0.0)};
+    ASSERT_EQ(2, simplifyPolyline(two_points, PATH_SIMPLIFY_TOLERANCE).size());
+}
+
+TEST(PathIngestSchedule, PathIngestSchedule){
+
+    // A wait on a straight run keeps its waypoints and times
+    std::vector<RVO::Vector2> points = {RVO::Vector2(0.0, 0.0), RVO::Vector2(1.0, 0.0),
+                                        RVO::Vector2(1.0, 0.0), RVO::Vector2(2.0, 0.0)};
+    std::vector<double> times = {0.0, 2.0, 3.0, 7.0};
+    AgentPath waiting = simplifiedPath(points, times);
+    ASSERT_EQ(4, waiting.totalSize());
+    ASSERT_DOUBLE_EQ(0.0, waiting.scheduledSpeed(2.5));
+    ASSERT_NEAR(0.5, waiting.scheduledSpeed(1.0), 1e-6);
+
+    // So does a speed change, 1 m in 1 s and then 1 m in 9 s
+    points = {RVO::Vector2(0.0, 0.0), RVO::Vector2(1.0, 0.0), RVO::Vector2(2.0, 0.0)};
+    times = {0.0, 1.0, 10.0};
+    AgentPath slowing = simplifiedPath(points, times);
+    ASSERT_EQ(3, slowing.totalSize());
+    ASSERT_NEAR(1.0, slowing.scheduledSpeed(0.5), 1e-6);
+    ASSERT_NEAR(1.0/9.0, slowing.scheduledSpeed(5.0), 1e-6);
+
+    // Constant speed and geometric paths are still simplified
+    points.clear();
+    times.clear();
+    for(int i = 0; i <= 100; i++) {
+        points.push_back(RVO::Vector2(0.01*i, 0.0));
+        times.push_back(0.05*i);
+    }
+    AgentPath constant = simplifiedPath(points, times);
+    ASSERT_EQ(2, constant.totalSize());
+    ASSERT_DOUBLE_EQ(5.0, constant.time(1));
+    std::fill(times.begin(), times.end(), 0.0);
+    ASSERT_EQ(2, simplifiedPath(points, times).totalSize());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
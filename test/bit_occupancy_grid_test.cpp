@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include "lazy_traffic_bitgrid.hpp"
+
+TEST(BitGridBuild, BitGridBuild){
+
+    // Odd sizes so that blocks are partially filled
+    int map_width = 150;
+    int map_height = 21;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    srand(3);
+    for(int i = 0; i < map_width*map_height; i++) {
+        int r = rand()%4;
+        map_data[i] = r == 0 ? 100 : (r == 1 ? -1 : 0);
+    }
+
+    BitOccupancyGrid grid;
+    grid.build(map_data, map_width, map_height);
+    ASSERT_EQ(3, grid.blocksX());
+    ASSERT_EQ(3, grid.blocksY());
+
+    for(int y = 0; y < map_height; y++) {
+        for(int x = 0; x < map_width; x++)
+            ASSERT_EQ(map_data[x + y*map_width] > 0, grid.occupied(x, y));
+    }
+    ASSERT_FALSE(grid.occupied(-1, 0));
+    ASSERT_FALSE(grid.occupied(map_width, 0));
+
+    // Unaligned row reads
+    for(int x0 = -10; x0 < map_width; x0 += 7) {
+        uint64_t bits = grid.rowBits(x0, 5);
+        for(int i = 0; i < 64; i++)
+            ASSERT_EQ(grid.occupied(x0 + i, 5), (bool)((bits >> i) & 1ULL));
+    }
+
+    // Copies are deep
+    BitOccupancyGrid copy(grid);
+    grid.set(0, 0);
+    grid.set(1, 0);
+    ASSERT_EQ(map_data[0] > 0, copy.occupied(0, 0));
+    ASSERT_TRUE(grid.occupied(1, 0));
+}
+
+TEST(BitGridBlocks, BitGridBlocks){
+
+    int map_width = 130;
+    int map_height = 17;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    map_data[129 + 16*map_width] = 100;
+
+    BitOccupancyGrid grid;
+    grid.build(map_data, map_width, map_height);
+    for(int by = 0; by < grid.blocksY(); by++) {
+        for(int bx = 0; bx < grid.blocksX(); bx++)
+            ASSERT_EQ(bx == 2 && by == 2, grid.blockAny(bx, by));
+    }
+
+    // Downsampling keeps the max of each 2x2 cell
+    BitOccupancyGrid parent;
+    grid.downsample(parent);
+    ASSERT_EQ(65, parent.width());
+    ASSERT_EQ(9, parent.height());
+    for(int y = 0; y < parent.height(); y++) {
+        for(int x = 0; x < parent.width(); x++)
+            ASSERT_EQ(x == 64 && y == 8, parent.occupied(x, y));
+    }
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
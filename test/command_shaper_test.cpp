@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "lazy_traffic_shaper.hpp"
+
+TEST(CommandShaperLimits, CommandShaperLimits){
+
+    double dt = 0.2;
+    CommandShaper shaper;
+    shaper.setControlPeriod(dt);
+    shaper.setLinearLimits(0.5, 2.5);
+    shaper.setAngularLimits(2.0, 10.0);
+
+    // Step from rest to full speed, acceleration and jerk stay within limits
+    double last_linear = 0.0, last_acc = 0.0;
+    for(int i = 0; i < 50; i++) {
+        double linear = 0.3, angular = 0.5;
+        shaper.shape(linear, angular);
+        double acc = (linear - last_linear)/dt;
+        ASSERT_LE(fabs(acc), 0.5 + 1e-9);
+        ASSERT_LE(fabs(acc - last_acc)/dt, 2.5 + 1e-9);
+        ASSERT_LE(linear, 0.3 + 1e-9);
+        ASSERT_LE(angular, 0.5 + 1e-9);
+        last_linear = linear;
+        last_acc = acc;
+    }
+    ASSERT_NEAR(0.3, shaper.linear(), 1e-9);
+    ASSERT_NEAR(0.5, shaper.angular(), 1e-9);
+    ASSERT_FALSE(shaper.atRest());
+
+    // First step is bounded by the jerk limit
+    shaper.reset();
+    double linear = 0.3, angular = 0.0;
+    shaper.shape(linear, angular);
+    ASSERT_NEAR(2.5*dt*dt, linear, 1e-9);
+
+    // Ramp down to zero without undershooting
+    for(int i = 0; i < 50; i++) {
+        linear = 0.0;
+        angular = 0.0;
+        shaper.shape(linear, angular);
+        ASSERT_GE(linear, 0.0);
+    }
+    ASSERT_TRUE(shaper.atRest());
+}
+
+TEST(CommandShaperReset, CommandShaperReset){
+
+    CommandShaper shaper;
+    shaper.setControlPeriod(0.2);
+    shaper.setLinearLimits(0.5, 2.5);
+    shaper.setAngularLimits(2.0, 10.0);
+
+    // Commands sent around the shaper are picked up on reset
+    shaper.reset(0.0, 0.5);
+    double linear = 0.0, angular = 0.5;
+    shaper.shape(linear, angular);
+    ASSERT_NEAR(0.5, angular, 1e-9);
+    ASSERT_NEAR(0.0, linear, 1e-9);
+
+    // Without a period nothing changes
+    CommandShaper idle;
+    linear = 0.3;
+    angular = 0.3;
+    idle.shape(linear, angular);
+    ASSERT_NEAR(0.0, linear, 1e-9);
+    ASSERT_TRUE(idle.atRest());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "lazy_traffic_timing.hpp"
+
+TEST(TimingStat, TimingStat){
+
+    TimingStat stat;
+    ASSERT_DOUBLE_EQ(0.0, stat.mean());
+    stat.add(0.01);
+    stat.add(0.03);
+    stat.add(0.02);
+    ASSERT_EQ(3, stat.count);
+    ASSERT_NEAR(0.02, stat.mean(), 1e-12);
+    ASSERT_DOUBLE_EQ(0.03, stat.max);
+    stat.reset();
+    ASSERT_EQ(0, stat.count);
+    ASSERT_DOUBLE_EQ(0.0, stat.max);
+
+    // Carries over whole seconds
+    timespec ts = nsToTimespec(timespecToNs(nsToTimespec(999999999LL)) + 2);
+    ASSERT_EQ(1, ts.tv_sec);
+    ASSERT_EQ(1, ts.tv_nsec);
+}
+
+TEST(DeadlineClock, DeadlineClock){
+
+    // Deadlines do not drift with the time spent in a tick. Only the deadlines are
+    // checked, how late the thread wakes up depends on the machine.
+    const int64_t period = 10000000LL;
+    DeadlineClock clock(0.01);
+    clock.start();
+    clock.wait();
+    int64_t expected = clock.deadline();
+    for(int i = 0; i < 5; i++) {
+        // Never woken before the deadline
+        ASSERT_GE(monotonicNs(), clock.deadline());
+        std::this_thread::sleep_for(std::chrono::milliseconds(4));
+        // A loaded machine can still overrun a tick, what it skips are whole periods
+        expected += (1 + clock.finish())*period;
+        clock.wait();
+        ASSERT_EQ(expected, clock.deadline());
+    }
+
+    // A tick of 2.5 periods misses and skips the deadlines it ran over, the next
+    // deadline is the first one still ahead of the end of the tick
+    int64_t deadline = clock.deadline();
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    int64_t end = monotonicNs();
+    uint32_t skipped = clock.finish();
+    ASSERT_GE(skipped, 2u);
+    ASSERT_EQ(deadline + skipped*period, clock.deadline());
+    ASSERT_GE(clock.deadline() + period, end);
+    clock.wait();
+    ASSERT_EQ(deadline + (skipped + 1)*period, clock.deadline());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include "lazy_traffic_fleet_obstacles.hpp"
+
+TEST(FleetObstaclesOverlap, FleetObstaclesOverlap){
+
+    int map_width = 200;
+    int map_height = 120;
+    float map_resolution = 0.05;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    srand(11);
+    for(int i = 0; i < map_width*map_height; i++)
+        map_data[i] = rand()%10 == 0 ? 100 : 0;
+
+    OccupancyPyramid pyramid;
+    pyramid.build(map_data, map_width, map_height, map_resolution, -1.0, -2.0);
+
+    // Agents clustered at home base plus one far away and one off the map
+    std::vector<RVO::Vector2> centres = {RVO::Vector2(2.0, 0.5), RVO::Vector2(2.2, 0.6), RVO::Vector2(2.1, 0.3),
+                                         RVO::Vector2(7.5, 3.0), RVO::Vector2(-5.0, -5.0)};
+    FleetObstacleIndex fleet_obstacles;
+    fleet_obstacles.build(pyramid, centres, 0.5);
+
+    size_t total = 0;
+    for(size_t a = 0; a < centres.size(); a++) {
+        std::vector<RVO::Vector2> expected;
+        pyramid.collectOccupied(centres[a], 0.5, expected);
+        ASSERT_EQ(expected.size(), fleet_obstacles.agentObstacles(a).size());
+        for(uint32_t index : fleet_obstacles.agentObstacles(a))
+            ASSERT_LE(absSq(fleet_obstacles.obstacle(index) - centres[a]), 0.25 + 1e-4);
+        total += expected.size();
+    }
+
+    // Overlapping disks share their obstacles
+    ASSERT_LT(fleet_obstacles.numObstacles(), total);
+    ASSERT_EQ(0, fleet_obstacles.agentObstacles(4).size());
+}
+
+TEST(FleetObstaclesFreeSpace, FleetObstaclesFreeSpace){
+
+    // One wall on an otherwise free map
+    int map_width = 200;
+    int map_height = 200;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    for(int y = 0; y < map_height; y++)
+        map_data[y*map_width + 150] = 100;
+
+    OccupancyPyramid pyramid;
+    pyramid.build(map_data, map_width, map_height, 0.05, 0.0, 0.0);
+
+    // Disks in open space are rejected by the coarse levels and get nothing
+    std::vector<RVO::Vector2> centres = {RVO::Vector2(2.0, 5.0), RVO::Vector2(7.3, 5.0), RVO::Vector2(1.0, 1.0)};
+    FleetObstacleIndex fleet_obstacles;
+    fleet_obstacles.build(pyramid, centres, 0.5);
+    ASSERT_EQ(0, fleet_obstacles.agentObstacles(0).size());
+    ASSERT_EQ(0, fleet_obstacles.agentObstacles(2).size());
+    std::vector<RVO::Vector2> expected;
+    pyramid.collectOccupied(centres[1], 0.5, expected);
+    ASSERT_EQ(expected.size(), fleet_obstacles.agentObstacles(1).size());
+    ASSERT_EQ(expected.size(), fleet_obstacles.numObstacles());
+}
+
+TEST(StaticObstacleCache, StaticObstacleCache){
+
+    StaticObstacleCache cache;
+
+    // Nothing cached yet
+    ASSERT_FALSE(cache.lookup(1, 10, 20));
+    cache.store(1, 10, 20);
+    ASSERT_TRUE(cache.lookup(1, 10, 20));
+    ASSERT_TRUE(cache.lookup(1, 10, 20));
+
+    // Moving to another cell invalidates it
+    ASSERT_FALSE(cache.lookup(1, 11, 20));
+    ASSERT_FALSE(cache.lookup(1, 10, 19));
+    cache.store(1, 11, 20);
+    ASSERT_TRUE(cache.lookup(1, 11, 20));
+
+    // So does a new map, even in the same cell
+    ASSERT_FALSE(cache.lookup(2, 11, 20));
+    cache.store(2, 11, 20);
+    ASSERT_TRUE(cache.lookup(2, 11, 20));
+
+    ASSERT_EQ(4u, cache.hits);
+    ASSERT_EQ(4u, cache.misses);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
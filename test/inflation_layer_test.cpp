@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include "lazy_traffic_inflation.hpp"
+#include "lazy_traffic_rvo.hpp"
+
+TEST(InflationClearance, InflationClearance){
+
+    // 10 x 10 map at 0.1 m with a single obstacle at cell (5,5)
+    int map_width = 10;
+    int map_height = 10;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    map_data[55] = 100;
+
+    InflationLayer layer;
+    layer.build(map_data, map_width, map_height, 0.1, 0.0, 0.0, 0.2);
+
+    ASSERT_NEAR(-0.2, layer.clearance(RVO::Vector2(0.5, 0.5)), 1e-4);
+    ASSERT_NEAR(0.1, layer.clearance(RVO::Vector2(0.8, 0.5)), 1e-4);
+    ASSERT_NEAR(sqrt(0.18) - 0.2, layer.clearance(RVO::Vector2(0.2, 0.2)), 1e-4);
+
+    // Unknown cells are free
+    map_data[55] = -1;
+    layer.build(map_data, map_width, map_height, 0.1, 0.0, 0.0, 0.2);
+    ASSERT_GT(layer.clearance(RVO::Vector2(0.5, 0.5)), 1.0);
+}
+
+TEST(InflationTimeToCollision, InflationTimeToCollision){
+
+    // Wall along x = 1.0
+    int map_width = 20;
+    int map_height = 20;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    for(int y = 0; y < map_height; y++)
+        map_data[10 + y*map_width] = 100;
+
+    InflationLayer layer;
+    layer.build(map_data, map_width, map_height, 0.1, 0.0, 0.0, 0.3);
+
+    // Heading straight at the wall from 0.5 m, footprint hit after 0.2 m
+    float time = layer.timeToCollision(RVO::Vector2(0.5, 1.0), RVO::Vector2(0.2, 0.0));
+    ASSERT_NEAR(1.0, time, 0.3);
+
+    // Moving away or parallel to the wall
+    time = layer.timeToCollision(RVO::Vector2(0.5, 1.0), RVO::Vector2(-0.2, 0.0));
+    ASSERT_FLOAT_EQ(INFLATION_TTC_INFTY, time);
+    time = layer.timeToCollision(RVO::Vector2(0.5, 1.0), RVO::Vector2(0.0, 0.2));
+    ASSERT_FLOAT_EQ(INFLATION_TTC_INFTY, time);
+
+    // Wall beyond the horizon
+    time = layer.timeToCollision(RVO::Vector2(0.1, 1.0), RVO::Vector2(0.2, 0.0));
+    ASSERT_FLOAT_EQ(INFLATION_TTC_INFTY, time);
+}
+
+TEST(InflationRVO, InflationRVO){
+
+    // Wall right in front of the agent
+    int map_width = 20;
+    int map_height = 20;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    for(int y = 0; y < map_height; y++)
+        map_data[10 + y*map_width] = 100;
+
+    InflationLayer layer;
+    layer.build(map_data, map_width, map_height, 0.1, 0.0, 0.0, RVO_RADIUS_MULT_FACTOR_HOMING*RVO_AGENT_RADIUS);
+
+    rvo_agent_obstacle_info_s agent_info = {"test_agent",RVO::Vector2(0.0,0.0),
+                                            RVO::Vector2(0.3,0.0),RVO::Vector2(0.55,1.0),0.3};
+    std::vector<rvo_agent_obstacle_info_s> neighbors_list;
+
+    RVO::Vector2 free_velocity = rvoComputeNewVelocity(agent_info, neighbors_list, false);
+    RVO::Vector2 new_velocity = rvoComputeNewVelocity(agent_info, neighbors_list, false, &layer);
+    ASSERT_FLOAT_EQ(0.3, free_velocity.x());
+    ASSERT_LT(new_velocity.x(), 0.3);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
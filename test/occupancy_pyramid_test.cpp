@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include "lazy_traffic_pyramid.hpp"
+
+// Brute force reference for collectOccupied
+int countOccupiedInDisk(const std::vector<int8_t>& map_data, int map_width, int map_height,
+                        float map_resolution, const RVO::Vector2& centre, float radius) {
+    int count = 0;
+    for(int y = 0; y < map_height; y++) {
+        for(int x = 0; x < map_width; x++) {
+            RVO::Vector2 position(map_resolution*x, map_resolution*y);
+            if(map_data[x + y*map_width] > 0 && absSq(position - centre) <= radius*radius)
+                count++;
+        }
+    }
+    return count;
+}
+
+TEST(PyramidLevels, PyramidLevels){
+
+    int map_width = 10;
+    int map_height = 6;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    map_data[9 + 5*map_width] = 100;
+
+    OccupancyPyramid pyramid;
+    pyramid.build(map_data, map_width, map_height, 0.1, 0.0, 0.0);
+
+    // 10x6 -> 5x3 -> 3x2 -> 2x1 -> 1x1
+    ASSERT_EQ(5, pyramid.numLevels());
+    ASSERT_TRUE(pyramid.occupied(0, 9, 5));
+    ASSERT_TRUE(pyramid.occupied(1, 4, 2));
+    ASSERT_TRUE(pyramid.occupied(4, 0, 0));
+    ASSERT_FALSE(pyramid.occupied(1, 0, 0));
+
+    ASSERT_TRUE(pyramid.anyOccupied(8, 4, 9, 5));
+    ASSERT_FALSE(pyramid.anyOccupied(0, 0, 8, 5));
+    ASSERT_FALSE(pyramid.anyOccupied(0, 0, 9, 4));
+}
+
+TEST(PyramidCollect, PyramidCollect){
+
+    int map_width = 100;
+    int map_height = 80;
+    float map_resolution = 0.05;
+    std::vector<int8_t> map_data(map_width*map_height, 0);
+    srand(7);
+    for(int i = 0; i < map_width*map_height; i++) {
+        int r = rand()%20;
+        map_data[i] = r == 0 ? 100 : (r == 1 ? -1 : 0);
+    }
+
+    OccupancyPyramid pyramid;
+    pyramid.build(map_data, map_width, map_height, map_resolution, 0.0, 0.0);
+
+    std::vector<RVO::Vector2> centres = {RVO::Vector2(2.5, 2.0), RVO::Vector2(0.0, 0.0),
+                                         RVO::Vector2(4.9, 3.9), RVO::Vector2(1.23, 3.21)};
+    for(const auto& centre : centres) {
+        std::vector<RVO::Vector2> obstacles;
+        pyramid.collectOccupied(centre, 0.5, obstacles);
+        EXPECT_EQ(countOccupiedInDisk(map_data, map_width, map_height, map_resolution, centre, 0.5), obstacles.size());
+    }
+
+    // Empty map returns nothing
+    std::vector<int8_t> empty_map(map_width*map_height, 0);
+    pyramid.build(empty_map, map_width, map_height, map_resolution, 0.0, 0.0);
+    std::vector<RVO::Vector2> obstacles;
+    pyramid.collectOccupied(RVO::Vector2(2.5, 2.0), 2.0, obstacles);
+    EXPECT_EQ(0, obstacles.size());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
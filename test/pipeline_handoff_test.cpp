@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "lazy_traffic_pipeline.hpp"
+
+TEST(HandoffQueueBounds, HandoffQueueBounds){
+
+    HandoffQueue<int> queue(2);
+    int item = -1;
+
+    // Times out when nothing is handed over
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_FALSE(queue.pop(item, 0.02));
+    ASSERT_GE(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 0.015);
+
+    // Producer is never held up by a full queue
+    ASSERT_TRUE(queue.push(1));
+    ASSERT_TRUE(queue.push(2));
+    ASSERT_FALSE(queue.push(3));
+    ASSERT_TRUE(queue.pop(item, 0.0));
+    ASSERT_EQ(1, item);
+    ASSERT_TRUE(queue.pop(item, 0.0));
+    ASSERT_EQ(2, item);
+}
+
+TEST(HandoffQueueStages, HandoffQueueStages){
+
+    // Three stages, the last one sees every item in order
+    const int count = 10000;
+    HandoffQueue<int> first(4);
+    HandoffQueue<int> second(4);
+    std::thread producer([&first, count]() {
+        for(int i = 0; i < count; i++) {
+            while(!first.push(int(i)))
+                std::this_thread::yield();
+        }
+    });
+    std::thread middle([&first, &second, count]() {
+        int item;
+        for(int i = 0; i < count; i++) {
+            while(!first.pop(item, 0.1));
+            while(!second.push(item*2))
+                std::this_thread::yield();
+        }
+    });
+
+    int item;
+    for(int i = 0; i < count; i++) {
+        ASSERT_TRUE(second.pop(item, 1.0));
+        ASSERT_EQ(2*i, item);
+    }
+    producer.join();
+    middle.join();
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "pure_pursuit_tracker.hpp"
+
+TEST(PurePursuitStep, PurePursuitStep){
+
+    // 0.1 m spaced straight line along x
+    AgentPath path;
+    for(int i = 0; i <= 20; i++)
+        path.push_back(RVO::Vector2(0.1*i, 0.0));
+
+    PurePursuitTracker tracker;
+    PurePursuitTarget target = tracker.step(path, RVO::Vector2(0.55, 0.2), 0.4);
+    ASSERT_NEAR(0.55, target.progress, 1e-5);
+    ASSERT_NEAR(0.95, target.s, 1e-5);
+    ASSERT_NEAR(0.95, target.point.x(), 1e-5);
+    ASSERT_NEAR(0.0, target.point.y(), 1e-5);
+    ASSERT_FALSE(target.end_of_path);
+    ASSERT_EQ(5, path.cursor());
+
+    // Near the end the lookahead stays on the last waypoint
+    tracker.step(path, RVO::Vector2(1.0, 0.0), 0.4);
+    target = tracker.step(path, RVO::Vector2(1.9, 0.0), 0.4);
+    ASSERT_TRUE(target.end_of_path);
+    ASSERT_NEAR(2.0, target.point.x(), 1e-5);
+    ASSERT_EQ(1, path.size());
+
+    // or continues along the last segment
+    PurePursuitTracker extending(true);
+    target = extending.step(path, RVO::Vector2(1.9, 0.0), 0.4);
+    ASSERT_NEAR(2.3, target.point.x(), 1e-5);
+    ASSERT_NEAR(0.0, target.point.y(), 1e-5);
+}
+
+TEST(PurePursuitGeometry, PurePursuitGeometry){
+
+    // Robot at (1,1) facing +y, a point ahead and to the left
+    RVO::Vector2 local = PurePursuitTracker::toRobotFrame(RVO::Vector2(0.5, 2.0), SE2::fromYaw(1.0, 1.0, M_PI/2));
+    ASSERT_NEAR(1.0, local.x(), 1e-5);
+    ASSERT_NEAR(0.5, local.y(), 1e-5);
+
+    // Arc through the robot and (1,1) in its frame has radius 1
+    ASSERT_NEAR(1.0, PurePursuitTracker::curvature(RVO::Vector2(1.0, 1.0)), 1e-6);
+    ASSERT_NEAR(0.0, PurePursuitTracker::curvature(RVO::Vector2(1.0, 0.0)), 1e-6);
+    ASSERT_NEAR(0.0, PurePursuitTracker::curvature(RVO::Vector2(0.0, 0.0)), 1e-6);
+}
+
+TEST(PurePursuitTime, PurePursuitTime){
+
+    AgentPath path;
+    path.push_back(RVO::Vector2(0.0, 0.0), 0.0);
+    path.push_back(RVO::Vector2(1.0, 0.0), 1.0);
+    path.push_back(RVO::Vector2(2.0, 0.0), 2.0);
+
+    ASSERT_EQ(0, PurePursuitTracker::advanceByTime(path, 0, 0.0, true));
+    ASSERT_EQ(2, PurePursuitTracker::advanceByTime(path, 0, 1.5, true));
+    ASSERT_EQ(2, PurePursuitTracker::advanceByTime(path, 0, 5.0, true));
+    ASSERT_EQ(3, PurePursuitTracker::advanceByTime(path, 0, 5.0, false));
+    // Never moves back
+    ASSERT_EQ(2, PurePursuitTracker::advanceByTime(path, 2, 0.0, false));
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "se2.hpp"
+
+TEST(SE2Compose, SE2Compose){
+
+    SE2 a = SE2::fromYaw(1.0, 2.0, M_PI/2);
+    SE2 b = SE2::fromYaw(0.5, 0.0, M_PI/4);
+
+    // b expressed in the world through a
+    SE2 ab = a*b;
+    ASSERT_NEAR(1.0, ab.x, 1e-9);
+    ASSERT_NEAR(2.5, ab.y, 1e-9);
+    ASSERT_NEAR(3*M_PI/4, ab.yaw(), 1e-9);
+
+    // Inverse undoes the transform
+    SE2 identity = a.inverse()*a;
+    ASSERT_NEAR(0.0, identity.x, 1e-9);
+    ASSERT_NEAR(0.0, identity.y, 1e-9);
+    ASSERT_NEAR(1.0, identity.c, 1e-9);
+    ASSERT_NEAR(0.0, identity.s, 1e-9);
+
+    RVO::Vector2 p = a.transform(RVO::Vector2(1.0, 0.0));
+    ASSERT_NEAR(1.0, p.x(), 1e-6);
+    ASSERT_NEAR(3.0, p.y(), 1e-6);
+    RVO::Vector2 q = a.inverseTransform(p);
+    ASSERT_NEAR(1.0, q.x(), 1e-6);
+    ASSERT_NEAR(0.0, q.y(), 1e-6);
+
+    // Usable at compile time
+    constexpr SE2 shift(1.0, 0.0, 1.0, 0.0);
+    constexpr SE2 twice = shift*shift;
+    static_assert(twice.x == 2.0, "SE2 composition should be constexpr");
+}
+
+TEST(SE2Quaternion, SE2Quaternion){
+
+    // Round trip through the (qz, qw) of a rotation about z
+    for(double yaw = -3.0; yaw <= 3.0; yaw += 0.5) {
+        SE2 pose = SE2::fromQuaternion(0.0, 0.0, sin(yaw/2), cos(yaw/2));
+        ASSERT_NEAR(yaw, pose.yaw(), 1e-9);
+        double qz, qw;
+        pose.toQuaternion(qz, qw);
+        ASSERT_NEAR(sin(yaw/2), qz, 1e-9);
+        ASSERT_NEAR(cos(yaw/2), qw, 1e-9);
+    }
+
+    // Heading from a direction
+    SE2 pose = SE2::fromDirection(0.0, 0.0, 0.0, -2.0);
+    ASSERT_NEAR(-M_PI/2, pose.yaw(), 1e-9);
+    pose = SE2::fromDirection(0.0, 0.0, 0.0, 0.0);
+    ASSERT_NEAR(0.0, pose.yaw(), 1e-9);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include "lazy_traffic_spsc.hpp"
+
+TEST(SpscQueueBounds, SpscQueueBounds){
+
+    SpscQueue<int> queue(3);
+    int item = -1;
+    ASSERT_TRUE(queue.empty());
+    ASSERT_FALSE(queue.pop(item));
+    ASSERT_EQ(3, queue.capacity());
+
+    for(int i = 0; i < 3; i++)
+        ASSERT_TRUE(queue.push(int(i)));
+    ASSERT_FALSE(queue.push(3));
+
+    // FIFO order, including across the wrap around
+    ASSERT_TRUE(queue.pop(item));
+    ASSERT_EQ(0, item);
+    ASSERT_TRUE(queue.push(3));
+    for(int i = 1; i <= 3; i++) {
+        ASSERT_TRUE(queue.pop(item));
+        ASSERT_EQ(i, item);
+    }
+    ASSERT_TRUE(queue.empty());
+
+    // A rejected item is not moved from
+    SpscQueue<std::unique_ptr<int>> owners(1);
+    ASSERT_TRUE(owners.push(std::unique_ptr<int>(new int(1))));
+    std::unique_ptr<int> second(new int(2));
+    ASSERT_FALSE(owners.push(std::move(second)));
+    ASSERT_TRUE(second != nullptr);
+}
+
+TEST(SpscQueueThreads, SpscQueueThreads){
+
+    // Producer and consumer on their own threads, nothing is lost or reordered
+    const int count = 200000;
+    SpscQueue<int> queue(16);
+    std::thread producer([&queue, count]() {
+        for(int i = 0; i < count; i++) {
+            while(!queue.push(int(i)))
+                std::this_thread::yield();
+        }
+    });
+
+    int expected = 0;
+    while(expected < count) {
+        int item;
+        if(queue.pop(item)) {
+            ASSERT_EQ(expected, item);
+            expected++;
+        }
+        else
+            std::this_thread::yield();
+    }
+    producer.join();
+    ASSERT_TRUE(queue.empty());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -102,6 +102,64 @@ TEST(BFSCollision, BFSCollision){
     // ASSERT_NE(RVO_INFTY, time);
     // std::cout<<"Time to collision is "<<time<<std::endl;
 }
+
+TEST(PredictedNeighbor, PredictedNeighbor){
+
+    // Neighbor 1 m ahead, measured coming straight at the ego agent
+    rvo_agent_obstacle_info_s ego;
+    ego.current_position = RVO::Vector2(0.0, 0.0);
+    ego.preferred_velocity = RVO::Vector2(0.3, 0.0);
+    ego.currrent_velocity = RVO::Vector2(0.3, 0.0);
+    ego.max_vel = 0.3;
+
+    rvo_agent_obstacle_info_s neighbor;
+    neighbor.agent_name = "agent_1";
+    neighbor.current_position = RVO::Vector2(1.0, 0.0);
+    neighbor.currrent_velocity = RVO::Vector2(-0.3, 0.0);
+    neighbor.max_vel = 0.3;
+    std::vector<rvo_agent_obstacle_info_s> neighbors(1, neighbor);
+
+    srand(1);
+    RVO::Vector2 velocity = rvoComputeNewVelocity(ego, neighbors, false);
+    ASSERT_GT(abs(velocity - ego.preferred_velocity), 1e-3);
+
+    // Its path turns it around, so the preferred velocity is free
+    neighbors[0].prediction_dt = 0.25;
+    for(int k = 0; k <= PREDICTION_SAMPLES; k++)
+        neighbors[0].predicted_path[k] = RVO::Vector2(1.0 + 0.3*0.25*k, 0.0);
+    neighbors[0].predicted_velocity = RVO::Vector2(0.3, 0.0);
+    neighbors[0].has_prediction = true;
+    srand(1);
+    velocity = rvoComputeNewVelocity(ego, neighbors, false);
+    ASSERT_NEAR(0.3, velocity.x(), 1e-6);
+    ASSERT_NEAR(0.0, velocity.y(), 1e-6);
+}
+
+TEST(PredictedPathCollision, PredictedPathCollision){
+
+    // Neighbor comes down to the ego agent's line and turns head on into it
+    rvo_agent_obstacle_info_s neighbor;
+    neighbor.current_position = RVO::Vector2(3.0, 2.0);
+    neighbor.prediction_dt = 1.0;
+    RVO::Vector2 samples[PREDICTION_SAMPLES + 1] = {RVO::Vector2(3.0, 2.0), RVO::Vector2(3.0, 1.0), RVO::Vector2(3.0, 0.0),
+                                                    RVO::Vector2(2.0, 0.0), RVO::Vector2(1.0, 0.0)};
+    for(int k = 0; k <= PREDICTION_SAMPLES; k++)
+        neighbor.predicted_path[k] = samples[k];
+    neighbor.has_prediction = true;
+
+    RVO::Vector2 position(0.0, 0.0);
+    RVO::Vector2 velocity(1.0, 0.0);
+    float time = rvoPredictedTimeToCollision(position, velocity, neighbor, 0.2);
+    ASSERT_NEAR(2.4, time, 1e-4);
+
+    // The chord over the whole horizon cuts the turn and misses it
+    RVO::Vector2 chord = (samples[PREDICTION_SAMPLES] - samples[0]) / (PREDICTION_SAMPLES*neighbor.prediction_dt);
+    ASSERT_EQ(RVO_INFTY, rvoTimeToCollision(position, velocity - chord, samples[0], 0.2, false));
+
+    // Moving away along the same line never meets it
+    ASSERT_EQ(RVO_INFTY, rvoPredictedTimeToCollision(position, RVO::Vector2(-1.0, 0.0), neighbor, 0.2));
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include "lazy_traffic_scheduler.hpp"
+
+TEST(UpdateSchedulerRisk, UpdateSchedulerRisk){
+
+    UpdateScheduler scheduler(5);
+
+    // Alone and on the path : longest interval
+    AgentRisk isolated;
+    ASSERT_DOUBLE_EQ(0.0, UpdateScheduler::risk(isolated));
+    ASSERT_EQ(5, scheduler.interval(isolated));
+
+    // Any one input at its risky value means every tick
+    AgentRisk closing;
+    closing.ttc = SCHED_TTC_RISK;
+    ASSERT_EQ(1, scheduler.interval(closing));
+    closing.ttc = 0.0;
+    ASSERT_EQ(1, scheduler.interval(closing));
+    AgentRisk crowded;
+    crowded.neighbors = SCHED_DENSITY_RISK + 2;
+    ASSERT_EQ(1, scheduler.interval(crowded));
+    AgentRisk off_path;
+    off_path.tracking_error = SCHED_TRACKING_RISK;
+    ASSERT_EQ(1, scheduler.interval(off_path));
+
+    // In between, the highest risk decides
+    AgentRisk mixed;
+    mixed.ttc = 0.5*(SCHED_TTC_RISK + SCHED_TTC_SAFE);
+    mixed.tracking_error = 0.1*SCHED_TRACKING_RISK;
+    ASSERT_NEAR(0.5, UpdateScheduler::risk(mixed), 1e-9);
+    ASSERT_EQ(3, scheduler.interval(mixed));
+}
+
+TEST(UpdateSchedulerStaleness, UpdateSchedulerStaleness){
+
+    // An agent is never left more than the longest interval without an update
+    UpdateScheduler scheduler(4);
+    UpdateSchedule schedule;
+    AgentRisk isolated;
+    int updates = 0;
+    uint32_t longest = 0, since_update = 0;
+    for(int tick = 0; tick < 40; tick++) {
+        since_update++;
+        if(schedule.tick()) {
+            schedule.updated(scheduler.interval(isolated));
+            longest = std::max(longest, since_update);
+            since_update = 0;
+            updates++;
+        }
+    }
+    ASSERT_EQ(4, longest);
+    ASSERT_EQ(10, updates);
+
+    // A woken agent is due in the next tick, however long its interval
+    schedule.updated(4);
+    ASSERT_FALSE(schedule.tick());
+    schedule.wake();
+    ASSERT_TRUE(schedule.tick());
+
+    // Unscheduled agents start due and a scheduler of 1 updates every tick
+    UpdateSchedule fresh;
+    ASSERT_TRUE(fresh.tick());
+    UpdateScheduler every_tick(0);
+    ASSERT_EQ(1, every_tick.interval(isolated));
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}